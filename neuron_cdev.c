@@ -11,9 +11,11 @@
 #include <linux/kernel.h>
 #include <linux/poll.h>
 #include <linux/cdev.h>
+#include <linux/mm.h>
 #include <linux/sched.h>
 #include <linux/device.h>
 #include <linux/pci.h>
+#include <linux/eventfd.h>
 
 #include "neuron_ioctl.h"
 #include "neuron_device.h"
@@ -32,24 +34,65 @@ static struct class *neuron_dev_class;
 /* one device node per device */
 #define NEURON_MAX_DEV_NODES MAX_NEURON_DEVICE_COUNT
 
+/* mem chunks are mapped after the notification queue window, 1GB(separate vma) per chunk */
+#define NCDEV_MC_MMAP_SLOTS 64
+#define NCDEV_MC_MMAP_START_OFFSET NC_SYNC_MMAP_END_OFFSET
+#define NCDEV_MC_MMAP_END_OFFSET \
+	(NCDEV_MC_MMAP_START_OFFSET + (NCDEV_MC_MMAP_SLOTS * NC_NQ_MMAP_SIZE_PER_NQ))
+
 struct ncdev {
 	int minor;
 	int open_count; // number of times this node is opened.
 	struct cdev *cdev;
 	struct neuron_device *ndev; // neuron device associated with this device node.
+	struct mem_chunk *mmap_mc[NCDEV_MC_MMAP_SLOTS]; // mem chunks registered for mmap()
 };
 
 /* char device nodes created for each device. */
 static struct ncdev devnodes[NEURON_MAX_DEV_NODES];
 
+/* Only one process can take ownership of a device. */
+static DEFINE_MUTEX(ncdev_device_lock);
+
 static u64 ncdev_mem_chunk_to_mem_handle(struct mem_chunk *mc)
 {
-	return (u64)mc;
+	return (u64)mc->handle;
+}
+
+/* Returns the chunk pinned; the caller must release it with mc_put() when done. */
+static struct mem_chunk *ncdev_mem_handle_to_mem_chunk(struct neuron_device *nd, u64 mh)
+{
+	struct mem_chunk *mc = mc_get_by_handle(&nd->mpset, (int)mh);
+	if (mc == NULL)
+		pr_err("invalid memory handle %llu\n", mh);
+	return mc;
 }
 
-static struct mem_chunk *ncdev_mem_handle_to_mem_chunk(u64 mh)
+/* True if the calling process owns the given neuron core - either through a
+ * whole device claim(DEVICE_INIT) or a per core claim(NC_CLAIM).
+ */
+static bool ncdev_pid_owns_nc(struct neuron_device *nd, u32 nc_id)
 {
-	return (struct mem_chunk *)mh;
+	if (nd->current_pid == task_tgid_nr(current) || nd->current_pid == task_ppid_nr(current))
+		return true;
+	if (nc_id >= V1_NC_PER_DEVICE)
+		return false;
+	// claims change under ncdev_device_lock but are checked on the ioctl fast path
+	return READ_ONCE(nd->nc_pid[nc_id]) == task_tgid_nr(current);
+}
+
+/* True if the calling process owns the whole device or at least one neuron core. */
+static bool ncdev_pid_owns_any(struct neuron_device *nd)
+{
+	int nc_id;
+
+	if (nd->current_pid == task_tgid_nr(current))
+		return true;
+	for (nc_id = 0; nc_id < V1_NC_PER_DEVICE; nc_id++) {
+		if (READ_ONCE(nd->nc_pid[nc_id]) == task_tgid_nr(current))
+			return true;
+	}
+	return false;
 }
 
 static int ncdev_dma_engine_init(struct neuron_device *nd, void *param)
@@ -60,6 +103,8 @@ static int ncdev_dma_engine_init(struct neuron_device *nd, void *param)
 	if (ret)
 		return ret;
 
+	if (!ncdev_pid_owns_nc(nd, arg.eng_id / V1_DMA_ENG_PER_NC))
+		return -EACCES;
 	return ndmar_eng_init(nd, arg.eng_id);
 }
 
@@ -70,6 +115,8 @@ static int ncdev_dma_engine_set_state(struct neuron_device *nd, void *param)
 	ret = copy_from_user(&arg, (struct neuron_ioctl_dma_eng_set_state *)param, sizeof(arg));
 	if (ret)
 		return ret;
+	if (!ncdev_pid_owns_nc(nd, arg.eng_id / V1_DMA_ENG_PER_NC))
+		return -EACCES;
 	return ndmar_eng_set_state(nd, arg.eng_id, arg.state);
 }
 
@@ -99,59 +146,290 @@ static int ncdev_dma_queue_init(struct neuron_device *nd, void *param)
 	if (ret)
 		return -EACCES;
 
-	rx_mc = ncdev_mem_handle_to_mem_chunk(arg.rx_handle);
-	tx_mc = ncdev_mem_handle_to_mem_chunk(arg.tx_handle);
-	if (arg.rxc_handle)
-		rxc_mc = ncdev_mem_handle_to_mem_chunk(arg.rxc_handle);
-	else
-		rxc_mc = NULL;
+	if (!ncdev_pid_owns_nc(nd, arg.eng_id / V1_DMA_ENG_PER_NC))
+		return -EACCES;
+	rxc_mc = NULL;
+	rx_mc = ncdev_mem_handle_to_mem_chunk(nd, arg.rx_handle);
+	tx_mc = ncdev_mem_handle_to_mem_chunk(nd, arg.tx_handle);
+	if (rx_mc == NULL || tx_mc == NULL) {
+		ret = -EINVAL;
+		goto put;
+	}
+	// descriptor rings must be driver allocated, registered user memory can't back them
+	if (rx_mc->pages || tx_mc->pages) {
+		ret = -EINVAL;
+		goto put;
+	}
+	if (arg.rxc_handle) {
+		rxc_mc = ncdev_mem_handle_to_mem_chunk(nd, arg.rxc_handle);
+		if (rxc_mc == NULL) {
+			ret = -EINVAL;
+			goto put;
+		}
+	}
 	ret = ndmar_queue_init(nd, arg.eng_id, arg.qid, arg.tx_desc_count, arg.rx_desc_count, tx_mc,
 			       rx_mc, rxc_mc, arg.axi_port);
+put:
+	mc_put(rxc_mc);
+	mc_put(tx_mc);
+	mc_put(rx_mc);
+	return ret;
+}
+
+static int ncdev_dma_copy_descriptors_apply(struct neuron_device *nd,
+					    struct neuron_ioctl_dma_copy_descriptors *arg)
+{
+	struct mem_chunk *mc = ncdev_mem_handle_to_mem_chunk(nd, arg->mem_handle);
+	int ret;
+
+	if (!mc)
+		return -EINVAL;
+	if (!ncdev_pid_owns_nc(nd, mc->nc_id)) {
+		mc_put(mc);
+		return -EACCES;
+	}
+	// check access is within the range.
+	if (arg->offset + (arg->num_descs * sizeof(union udma_desc)) > mc->size) {
+		mc_put(mc);
+		return -EINVAL;
+	}
+
+	ret = ndma_memcpy_dma_copy_descriptors_user(nd, arg->buffer, mc, arg->offset,
+						    arg->num_descs * sizeof(union udma_desc),
+						    arg->queue_type);
+	mc_put(mc);
 	return ret;
 }
 
 static int ncdev_dma_copy_descriptors(struct neuron_device *nd, void *param)
 {
 	struct neuron_ioctl_dma_copy_descriptors arg;
-	struct mem_chunk *src_mc;
-	u32 offset = 0, copy_size = 0;
-	int remaining, ret;
+	int ret;
 
 	ret = copy_from_user(&arg, (struct neuron_ioctl_dma_copy_descriptors *)param, sizeof(arg));
 	if (ret)
 		return ret;
 
-	struct mem_chunk *mc = ncdev_mem_handle_to_mem_chunk(arg.mem_handle);
-	if (!mc)
+	return ncdev_dma_copy_descriptors_apply(nd, &arg);
+}
+
+/* A registered descriptor program. The descriptors live in the queue's backing memory,
+ * this only records what to re-execute when the program is triggered.
+ */
+struct ncdev_dma_program {
+	u32 eng_id;
+	u32 qid;
+	u32 tx_desc_count;
+	u32 rx_desc_count;
+};
+
+static int ncdev_dma_program_register(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_dma_program_register arg;
+	struct ncdev_dma_program *prog;
+	struct mem_chunk *tx_mc = NULL, *rx_mc = NULL;
+	u32 tx_size = 0, rx_size = 0;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_dma_program_register *)param,
+			     sizeof(arg));
+	if (ret)
+		return ret;
+	if (arg.tx_desc_count == 0 && arg.rx_desc_count == 0)
 		return -EINVAL;
-	// check access is within the range.
-	if (arg.offset + (arg.num_descs * sizeof(union udma_desc)) > mc->size) {
-		ret = -EINVAL;
-		goto out;
-	}
+	if (!ncdev_pid_owns_nc(nd, arg.eng_id / V1_DMA_ENG_PER_NC))
+		return -EACCES;
 
-	remaining = arg.num_descs * sizeof(union udma_desc);
-	ret = mc_alloc(&nd->mpset, &src_mc, MAX_DMA_DESC_SIZE, MEM_LOC_HOST, 0, 0, mc->nc_id);
+	ret = ndmar_queue_get_descriptor_mc(nd, arg.eng_id, arg.qid, &tx_mc, &rx_mc, &tx_size,
+					    &rx_size);
 	if (ret) {
-		ret = -ENOMEM;
-		goto out;
+		pr_err("get DMA queue desc failed %d\n", ret);
+		return -EINVAL;
 	}
-	while (remaining) {
-		copy_size = remaining < MAX_DMA_DESC_SIZE ? remaining : MAX_DMA_DESC_SIZE;
-		ret = copy_from_user(src_mc->va, arg.buffer + offset, copy_size);
-		if (ret) {
+	// an uninitialized queue has no backing memory; check only the directions in use
+	if (arg.tx_desc_count) {
+		if (tx_mc == NULL)
+			return -EINVAL;
+		// check access is within the range.
+		if (arg.tx_desc_count * sizeof(union udma_desc) > tx_mc->size)
+			return -EINVAL;
+	}
+	if (arg.rx_desc_count) {
+		if (rx_mc == NULL)
+			return -EINVAL;
+		// check access is within the range.
+		if (arg.rx_desc_count * sizeof(union udma_desc) > rx_mc->size)
+			return -EINVAL;
+	}
+
+	// load and validate the descriptors once; triggering skips both steps
+	if (arg.tx_desc_count) {
+		ret = ndma_memcpy_dma_copy_descriptors_user(
+			nd, arg.tx_buffer, tx_mc, 0, arg.tx_desc_count * sizeof(union udma_desc),
+			NEURON_DMA_QUEUE_TYPE_TX);
+		if (ret)
+			return ret;
+	}
+	if (arg.rx_desc_count) {
+		ret = ndma_memcpy_dma_copy_descriptors_user(
+			nd, arg.rx_buffer, rx_mc, 0, arg.rx_desc_count * sizeof(union udma_desc),
+			NEURON_DMA_QUEUE_TYPE_RX);
+		if (ret)
+			return ret;
+	}
+
+	prog = kzalloc(sizeof(*prog), GFP_KERNEL);
+	if (prog == NULL)
+		return -ENOMEM;
+	prog->eng_id = arg.eng_id;
+	prog->qid = arg.qid;
+	prog->tx_desc_count = arg.tx_desc_count;
+	prog->rx_desc_count = arg.rx_desc_count;
+
+	mutex_lock(&nd->dma_prog_lock);
+	ret = idr_alloc(&nd->dma_prog_idr, prog, 1, 0, GFP_KERNEL);
+	mutex_unlock(&nd->dma_prog_lock);
+	if (ret < 0) {
+		kfree(prog);
+		return ret;
+	}
+
+	arg.program_handle = ret;
+	if (copy_to_user(param, &arg, sizeof(arg))) {
+		mutex_lock(&nd->dma_prog_lock);
+		idr_remove(&nd->dma_prog_idr, (int)arg.program_handle);
+		mutex_unlock(&nd->dma_prog_lock);
+		kfree(prog);
+		return -EACCES;
+	}
+	return 0;
+}
+
+static int ncdev_dma_program_trigger(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_dma_program_trigger arg;
+	struct ncdev_dma_program *prog;
+	u32 eng_id = 0, qid = 0, tx_desc_count = 0, rx_desc_count = 0;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_dma_program_trigger *)param, sizeof(arg));
+	if (ret)
+		return ret;
+
+	mutex_lock(&nd->dma_prog_lock);
+	prog = idr_find(&nd->dma_prog_idr, (int)arg.program_handle);
+	if (prog) {
+		eng_id = prog->eng_id;
+		qid = prog->qid;
+		tx_desc_count = prog->tx_desc_count;
+		rx_desc_count = prog->rx_desc_count;
+	}
+	mutex_unlock(&nd->dma_prog_lock);
+	if (prog == NULL)
+		return -ENOENT;
+	if (!ncdev_pid_owns_nc(nd, eng_id / V1_DMA_ENG_PER_NC))
+		return -EACCES;
+
+	return ndmar_queue_replay(nd, eng_id, qid, tx_desc_count, rx_desc_count);
+}
+
+static int ncdev_dma_program_unregister(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_dma_program_trigger arg;
+	struct ncdev_dma_program *prog;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_dma_program_trigger *)param, sizeof(arg));
+	if (ret)
+		return ret;
+
+	mutex_lock(&nd->dma_prog_lock);
+	prog = idr_find(&nd->dma_prog_idr, (int)arg.program_handle);
+	if (prog) {
+		if (!ncdev_pid_owns_nc(nd, prog->eng_id / V1_DMA_ENG_PER_NC)) {
+			mutex_unlock(&nd->dma_prog_lock);
+			return -EACCES;
+		}
+		idr_remove(&nd->dma_prog_idr, (int)arg.program_handle);
+	}
+	mutex_unlock(&nd->dma_prog_lock);
+	if (prog == NULL)
+		return -ENOENT;
+	kfree(prog);
+	return 0;
+}
+
+/* Frees all registered descriptor programs - the queues they reference are going away. */
+static void ncdev_dma_program_drop_all(struct neuron_device *nd)
+{
+	struct ncdev_dma_program *prog;
+	int id;
+
+	mutex_lock(&nd->dma_prog_lock);
+	idr_for_each_entry(&nd->dma_prog_idr, prog, id) {
+		idr_remove(&nd->dma_prog_idr, id);
+		kfree(prog);
+	}
+	mutex_unlock(&nd->dma_prog_lock);
+}
+
+static long ncdev_dma_submit_batch(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_dma_submit_batch arg;
+	struct neuron_ioctl_dma_batch_entry *entries = NULL;
+	u32 i;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_dma_submit_batch *)param, sizeof(arg));
+	if (ret)
+		return ret;
+	if (arg.count == 0 || arg.count > NEURON_DMA_BATCH_MAX_ENTRIES)
+		return -EINVAL;
+
+	entries = kmalloc(arg.count * sizeof(*entries), GFP_KERNEL);
+	if (entries == NULL)
+		return -ENOMEM;
+	ret = copy_from_user(entries, arg.entries, arg.count * sizeof(*entries));
+	if (ret)
+		goto done;
+
+	for (i = 0; i < arg.count; i++) {
+		struct neuron_ioctl_dma_batch_entry *entry = &entries[i];
+		switch (entry->op) {
+		case NEURON_DMA_BATCH_COPY_DESCRIPTORS:
+			ret = ncdev_dma_copy_descriptors_apply(nd, &entry->copy_descriptors);
+			break;
+		case NEURON_DMA_BATCH_COPY_START:
+			if (!ncdev_pid_owns_nc(nd, entry->copy_start.eng_id / V1_DMA_ENG_PER_NC)) {
+				ret = -EACCES;
+				break;
+			}
+			ret = ndmar_queue_copy_start(nd, entry->copy_start.eng_id,
+						     entry->copy_start.qid,
+						     entry->copy_start.tx_desc_count,
+						     entry->copy_start.rx_desc_count);
+			break;
+		case NEURON_DMA_BATCH_ACK_COMPLETED:
+			if (!ncdev_pid_owns_nc(nd, entry->ack_completed.eng_id / V1_DMA_ENG_PER_NC)) {
+				ret = -EACCES;
+				break;
+			}
+			ret = ndmar_ack_completed(nd, entry->ack_completed.eng_id,
+						  entry->ack_completed.qid,
+						  entry->ack_completed.count);
+			break;
+		default:
+			ret = -EINVAL;
 			break;
 		}
-		ret = ndma_memcpy_dma_copy_descriptors(nd, src_mc->va, 0, mc, arg.offset + offset,
-						       copy_size, arg.queue_type);
 		if (ret) {
+			pr_err("batch entry %d(op:%d) failed - %d\n", i, entry->op, ret);
 			break;
 		}
-		remaining -= copy_size;
-		offset += copy_size;
 	}
-out:
-	mc_free(&src_mc);
+
+done:
+	kfree(entries);
 	return ret;
 }
 
@@ -163,6 +441,8 @@ static int ncdev_dma_copy_start(struct neuron_device *nd, void *param)
 	if (ret)
 		return ret;
 
+	if (!ncdev_pid_owns_nc(nd, arg.eng_id / V1_DMA_ENG_PER_NC))
+		return -EACCES;
 	ret = ndmar_queue_copy_start(nd, arg.eng_id, arg.qid, arg.tx_desc_count, arg.rx_desc_count);
 	return ret;
 }
@@ -175,6 +455,8 @@ static int ncdev_dma_ack_completed(struct neuron_device *nd, void *param)
 	if (ret)
 		return ret;
 
+	if (!ncdev_pid_owns_nc(nd, arg.eng_id / V1_DMA_ENG_PER_NC))
+		return -EACCES;
 	return ndmar_ack_completed(nd, arg.eng_id, arg.qid, arg.count);
 }
 
@@ -195,6 +477,65 @@ static int ncdev_dma_queue_get_state(struct neuron_device *nd, void *param)
 	return copy_to_user(arg.rx, &rx, sizeof(rx));
 }
 
+static int ncdev_dma_eng_snapshot(struct neuron_device *nd, void *param)
+{
+	int ret;
+	struct neuron_ioctl_dma_eng_snapshot arg;
+	struct neuron_dma_queue_state *tx, *rx;
+	u32 num_queues = 0;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_dma_eng_snapshot *)param, sizeof(arg));
+	if (ret)
+		return ret;
+
+	tx = kcalloc(DMA_MAX_Q_MAX * 2, sizeof(struct neuron_dma_queue_state), GFP_KERNEL);
+	if (tx == NULL)
+		return -ENOMEM;
+	rx = tx + DMA_MAX_Q_MAX;
+
+	ret = ndmar_eng_get_snapshot(nd, arg.eng_id, arg.sw_only != 0, arg.max_queues, tx, rx,
+				     &num_queues);
+	if (ret)
+		goto done;
+	arg.num_queues = num_queues;
+	ret = copy_to_user(arg.tx, tx, num_queues * sizeof(struct neuron_dma_queue_state));
+	if (ret)
+		goto done;
+	ret = copy_to_user(arg.rx, rx, num_queues * sizeof(struct neuron_dma_queue_state));
+	if (ret)
+		goto done;
+	ret = copy_to_user((struct neuron_ioctl_dma_eng_snapshot *)param, &arg, sizeof(arg));
+done:
+	kfree(tx);
+	return ret;
+}
+
+// keep the benchmark bounded so the ioctl can't monopolize the device for long
+#define DMA_BENCHMARK_MAX_SIZE (16 * 1024 * 1024)
+#define DMA_BENCHMARK_MAX_ITERATIONS 100000
+
+static int ncdev_dma_benchmark(struct neuron_device *nd, void *param)
+{
+	int ret;
+	struct neuron_ioctl_dma_benchmark arg;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_dma_benchmark *)param, sizeof(arg));
+	if (ret)
+		return ret;
+	if (arg.size == 0 || arg.size > DMA_BENCHMARK_MAX_SIZE)
+		return -EINVAL;
+	if (arg.iterations == 0 || arg.iterations > DMA_BENCHMARK_MAX_ITERATIONS)
+		return -EINVAL;
+	if (!ncdev_pid_owns_nc(nd, arg.nc_id))
+		return -EACCES;
+
+	ret = ndma_benchmark(nd, arg.nc_id, arg.direction, arg.size, arg.iterations,
+			     &arg.total_nsec, &arg.desc_nsec, &arg.bandwidth);
+	if (ret)
+		return ret;
+	return copy_to_user((struct neuron_ioctl_dma_benchmark *)param, &arg, sizeof(arg));
+}
+
 static int ncdev_dma_queue_release(struct neuron_device *nd, void *param)
 {
 	int ret;
@@ -202,6 +543,8 @@ static int ncdev_dma_queue_release(struct neuron_device *nd, void *param)
 	ret = copy_from_user(&arg, (struct neuron_ioctl_dma_queue_release *)param, sizeof(arg));
 	if (ret)
 		return ret;
+	if (!ncdev_pid_owns_nc(nd, arg.eng_id / V1_DMA_ENG_PER_NC))
+		return -EACCES;
 	return ndmar_queue_release(nd, arg.eng_id, arg.qid);
 }
 
@@ -282,6 +625,17 @@ static int ncdev_mem_alloc(struct neuron_device *nd, void *param)
 		location = MEM_LOC_HOST;
 	else
 		location = MEM_LOC_DEVICE;
+	// device memory comes from the arena of the core, so the core must be owned.
+	// a per core owner is further confined to the region matching its core so the
+	// arenas of the other owners stay untouched.
+	if (location == MEM_LOC_DEVICE) {
+		if (!ncdev_pid_owns_nc(nd, mem_alloc_arg.nc_id))
+			return -EACCES;
+		if (nd->current_pid != task_tgid_nr(current) &&
+		    nd->current_pid != task_ppid_nr(current) &&
+		    mem_alloc_arg.dram_region != mem_alloc_arg.nc_id)
+			return -EACCES;
+	}
 	ret = mc_alloc(&nd->mpset, &mc, mem_alloc_arg.size, location, mem_alloc_arg.dram_channel,
 		       mem_alloc_arg.dram_region, mem_alloc_arg.nc_id);
 	if (ret)
@@ -292,77 +646,507 @@ static int ncdev_mem_alloc(struct neuron_device *nd, void *param)
 	mh = ncdev_mem_chunk_to_mem_handle(mc);
 	ret = copy_to_user(mem_alloc_arg.mem_handle, &mh, sizeof(mc));
 	if (ret) {
-		mc_free(&mc);
-		return ret;
+		mc_free(&mc);
+		return ret;
+	}
+	return 0;
+}
+
+static int ncdev_mem_register(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_mem_register arg;
+	struct mem_chunk *mc;
+	u64 mh;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_mem_register *)param, sizeof(arg));
+	if (ret)
+		return -EACCES;
+
+	ret = mc_register_user_mem(&nd->mpset, arg.va, arg.size, &mc);
+	if (ret)
+		return ret;
+
+	trace_ioctl_mem_alloc(nd, mc);
+
+	mh = ncdev_mem_chunk_to_mem_handle(mc);
+	ret = copy_to_user(arg.mem_handle, &mh, sizeof(mh));
+	if (ret) {
+		mc_free(&mc);
+		return ret;
+	}
+	return 0;
+}
+
+static int ncdev_mem_get_pa(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_mem_get_pa mem_get_pa_arg;
+	struct mem_chunk *mc;
+	u64 pa;
+	int ret;
+
+	ret = copy_from_user(&mem_get_pa_arg, (struct neuron_ioctl_mem_get_pa *)param,
+			     sizeof(mem_get_pa_arg));
+	if (ret)
+		return ret;
+
+	mc = ncdev_mem_handle_to_mem_chunk(nd, mem_get_pa_arg.mem_handle);
+	if (mc == NULL)
+		return -EINVAL;
+	if (mc->nr_runs > 1) { // registered user memory with multiple runs has no single PA
+		mc_put(mc);
+		return -EINVAL;
+	}
+	if (mc->mem_location == MEM_LOC_HOST)
+		pa = mc->pa | PCIEX8_0_BASE;
+	else
+		pa = mc->pa;
+	mc_put(mc);
+	return copy_to_user(mem_get_pa_arg.pa, &pa, sizeof(u64));
+}
+
+/* Forget mmap registrations pointing to given mc(or all of them if mc is NULL).
+ * Must be called with ncdev_device_lock held.
+ */
+static void ncdev_mc_mmap_forget(struct ncdev *ncd, struct mem_chunk *mc)
+{
+	int i;
+	for (i = 0; i < NCDEV_MC_MMAP_SLOTS; i++) {
+		if (mc == NULL || ncd->mmap_mc[i] == mc)
+			ncd->mmap_mc[i] = NULL;
+	}
+}
+
+/* Forget mmap registrations of chunks allocated by the given process - used when a
+ * per core owner goes away and its chunks are freed, so no slot keeps pointing at a
+ * freed mem chunk. Must be called with ncdev_device_lock held.
+ */
+static void ncdev_mc_mmap_forget_pid(struct ncdev *ncd, pid_t pid)
+{
+	int i;
+	for (i = 0; i < NCDEV_MC_MMAP_SLOTS; i++) {
+		if (ncd->mmap_mc[i] != NULL && ncd->mmap_mc[i]->pid == pid)
+			ncd->mmap_mc[i] = NULL;
+	}
+}
+
+static long ncdev_mem_get_mmap_offset(struct ncdev *ncd, struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_mem_get_mmap_offset arg;
+	struct mem_chunk *mc;
+	int i, slot = -1;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_mem_get_mmap_offset *)param, sizeof(arg));
+	if (ret)
+		return ret;
+
+	mc = ncdev_mem_handle_to_mem_chunk(nd, arg.mem_handle);
+	if (mc == NULL)
+		return -EINVAL;
+	if (mc->size > NC_NQ_MMAP_SIZE_PER_NQ) {
+		mc_put(mc);
+		return -EFBIG;
+	}
+
+	// find already registered slot or a free one
+	mutex_lock(&ncdev_device_lock);
+	for (i = 0; i < NCDEV_MC_MMAP_SLOTS; i++) {
+		if (ncd->mmap_mc[i] == mc) {
+			slot = i;
+			break;
+		}
+		if (slot == -1 && ncd->mmap_mc[i] == NULL)
+			slot = i;
+	}
+	if (slot == -1) {
+		mutex_unlock(&ncdev_device_lock);
+		mc_put(mc);
+		return -ENOSPC;
+	}
+	ncd->mmap_mc[slot] = mc;
+	mutex_unlock(&ncdev_device_lock);
+	// the slot holds a bare pointer; a later free clears it via ncdev_mc_mmap_forget()
+	mc_put(mc);
+
+	arg.mmap_offset = NCDEV_MC_MMAP_START_OFFSET + (slot * NC_NQ_MMAP_SIZE_PER_NQ);
+	return copy_to_user((struct neuron_ioctl_mem_get_mmap_offset *)param, &arg, sizeof(arg));
+}
+
+static int ncdev_mc_mmap(struct ncdev *ncd, struct neuron_device *nd, u64 offset,
+			 struct vm_area_struct *vma)
+{
+	struct mem_chunk *mc;
+	u64 size = vma->vm_end - vma->vm_start;
+	u64 slot;
+	int ret;
+
+	if (offset < NCDEV_MC_MMAP_START_OFFSET || offset >= NCDEV_MC_MMAP_END_OFFSET)
+		return -EINVAL;
+	slot = (offset - NCDEV_MC_MMAP_START_OFFSET) / NC_NQ_MMAP_SIZE_PER_NQ;
+
+	// hold the lock so the slot can not be forgotten(and the chunk freed) while
+	// the mapping is set up
+	mutex_lock(&ncdev_device_lock);
+	mc = ncd->mmap_mc[slot];
+	if (mc == NULL) {
+		ret = -EINVAL;
+		goto out;
+	}
+	if (size > mc->size) {
+		ret = -EINVAL;
+		goto out;
+	}
+	// registered user memory is already mapped in the application
+	if (mc->pages) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (mc->mem_location == MEM_LOC_HOST) {
+		ret = remap_pfn_range(vma, vma->vm_start, PHYS_PFN(mc->pa), size,
+				      vma->vm_page_prot);
+	} else if (mc->pa >= P_0_NC_0_BASE &&
+		   (mc->pa + size) <= (P_0_NC_0_BASE + nd->npdev.bar2_size)) {
+		// device memory is reachable by the CPU only through the BAR2 aperture
+		vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+		ret = io_remap_pfn_range(vma, vma->vm_start,
+					 PHYS_PFN(nd->npdev.bar2_pa + (mc->pa - P_0_NC_0_BASE)),
+					 size, vma->vm_page_prot);
+	} else {
+		ret = -ENXIO;
+	}
+	if (ret != 0)
+		goto out;
+
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP | VM_DONTCOPY;
+
+out:
+	mutex_unlock(&ncdev_device_lock);
+	return ret;
+}
+
+static int ncdev_mem_free(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_mem_free mem_free_arg;
+	struct mem_chunk *mc;
+	int ret;
+
+	ret = copy_from_user(&mem_free_arg, (struct neuron_ioctl_mem_free *)param,
+			     sizeof(mem_free_arg));
+	if (ret)
+		return ret;
+	mc = ncdev_mem_handle_to_mem_chunk(nd, mem_free_arg.mem_handle);
+	if (mc == NULL)
+		return -EINVAL;
+	if (atomic_read(&mc->inflight) > 1) { // one pin is our own lookup
+		pr_err("mem handle is in use by another operation\n");
+		mc_put(mc);
+		return -EBUSY;
+	}
+	trace_ioctl_mem_alloc(nd, mc);
+	if (nd->cdev) {
+		mutex_lock(&ncdev_device_lock);
+		ncdev_mc_mmap_forget((struct ncdev *)nd->cdev, mc);
+		mutex_unlock(&ncdev_device_lock);
+	}
+	mc_put(mc);
+	// the authoritative pin check - a lookup racing with the check above can
+	// still pin the chunk, in which case this fails with -EBUSY instead
+	return mc_free_handle(&nd->mpset, (int)mem_free_arg.mem_handle);
+}
+
+static int ncdev_mem_copy(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_mem_copy arg;
+	struct mem_chunk *src_mc;
+	struct mem_chunk *dst_mc;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_mem_copy *)param, sizeof(arg));
+	if (ret)
+		return ret;
+	src_mc = ncdev_mem_handle_to_mem_chunk(nd, arg.src_mem_handle);
+	dst_mc = ncdev_mem_handle_to_mem_chunk(nd, arg.dst_mem_handle);
+	if (src_mc == NULL || dst_mc == NULL) {
+		ret = -EINVAL;
+		goto put;
+	}
+	// check access is within the range.
+	if (arg.src_offset + arg.size > src_mc->size) {
+		pr_err("src offset+size is too large for mem handle\n");
+		ret = -EINVAL;
+		goto put;
+	}
+	// check access is within the range.
+	if (arg.dst_offset + arg.size > dst_mc->size) {
+		pr_err("src offset+size is too large for mem handle\n");
+		ret = -EINVAL;
+		goto put;
+	}
+	ret = ndma_memcpy_mc(nd, src_mc, dst_mc, arg.src_offset, arg.dst_offset, arg.size);
+	if (ret) {
+		pr_err("dma memcpy failed\n");
+		goto put;
+	}
+	trace_ioctl_mem_copy(nd, src_mc, dst_mc);
+put:
+	mc_put(dst_mc);
+	mc_put(src_mc);
+	return ret;
+}
+
+/* One asynchronous DMA copy. Lives in the device's async_copy_idr from submission until the
+ * application reaps it with NEURON_IOCTL_MEM_COPY_ASYNC_STATUS(or the device is released).
+ */
+struct ncdev_async_copy {
+	struct work_struct work;
+	struct neuron_device *nd;
+	struct mem_chunk *src_mc;
+	struct mem_chunk *dst_mc;
+	u32 src_offset;
+	u32 dst_offset;
+	u32 size;
+	struct eventfd_ctx *efd; // signaled on completion(NULL if the app did not pass an eventfd)
+	int status; // -EBUSY while the transfer is in flight
+	int id;
+};
+
+static void ncdev_async_copy_free(struct ncdev_async_copy *ac)
+{
+	if (ac->efd)
+		eventfd_ctx_put(ac->efd);
+	kfree(ac);
+}
+
+static void ncdev_mem_copy_async_work(struct work_struct *work)
+{
+	struct ncdev_async_copy *ac = container_of(work, struct ncdev_async_copy, work);
+	struct neuron_device *nd = ac->nd;
+	int ret;
+
+	ret = ndma_memcpy_mc(nd, ac->src_mc, ac->dst_mc, ac->src_offset, ac->dst_offset, ac->size);
+	// the copy is done - drop the pins handed over at submit, the chunks may
+	// be freed from here on
+	mc_put(ac->src_mc);
+	mc_put(ac->dst_mc);
+	// status update and eventfd signal are done under the lock so that the status
+	// ioctl can not reap(free) the transfer between the two steps
+	spin_lock(&nd->async_copy_lock);
+	ac->status = ret;
+	if (ac->efd)
+		eventfd_signal(ac->efd, 1);
+	spin_unlock(&nd->async_copy_lock);
+}
+
+static int ncdev_mem_copy_async(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_mem_copy_async arg;
+	struct ncdev_async_copy *ac;
+	struct mem_chunk *src_mc;
+	struct mem_chunk *dst_mc;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_mem_copy_async *)param, sizeof(arg));
+	if (ret)
+		return ret;
+	src_mc = ncdev_mem_handle_to_mem_chunk(nd, arg.src_mem_handle);
+	dst_mc = ncdev_mem_handle_to_mem_chunk(nd, arg.dst_mem_handle);
+	if (src_mc == NULL || dst_mc == NULL) {
+		ret = -EINVAL;
+		goto put;
+	}
+	// check access is within the range(offset + size could wrap in u32)
+	if (arg.size > src_mc->size || arg.src_offset > src_mc->size - arg.size) {
+		pr_err("src offset+size is too large for mem handle\n");
+		ret = -EINVAL;
+		goto put;
+	}
+	// check access is within the range(offset + size could wrap in u32)
+	if (arg.size > dst_mc->size || arg.dst_offset > dst_mc->size - arg.size) {
+		pr_err("dst offset+size is too large for mem handle\n");
+		ret = -EINVAL;
+		goto put;
+	}
+
+	ac = kzalloc(sizeof(*ac), GFP_KERNEL);
+	if (ac == NULL) {
+		ret = -ENOMEM;
+		goto put;
+	}
+	if (arg.eventfd >= 0) {
+		ac->efd = eventfd_ctx_fdget(arg.eventfd);
+		if (IS_ERR(ac->efd)) {
+			ret = PTR_ERR(ac->efd);
+			ac->efd = NULL;
+			goto fail;
+		}
+	}
+	ac->nd = nd;
+	ac->src_mc = src_mc;
+	ac->dst_mc = dst_mc;
+	ac->src_offset = arg.src_offset;
+	ac->dst_offset = arg.dst_offset;
+	ac->size = arg.size;
+	ac->status = -EBUSY;
+	INIT_WORK(&ac->work, ncdev_mem_copy_async_work);
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&nd->async_copy_lock);
+	ret = idr_alloc_cyclic(&nd->async_copy_idr, ac, 1, 0, GFP_NOWAIT);
+	spin_unlock(&nd->async_copy_lock);
+	idr_preload_end();
+	if (ret < 0)
+		goto fail;
+	ac->id = ret;
+
+	// report the id before queueing so a submit failure can still be unwound
+	arg.transfer_id = ac->id;
+	ret = copy_to_user(param, &arg, sizeof(arg));
+	if (ret) {
+		spin_lock(&nd->async_copy_lock);
+		idr_remove(&nd->async_copy_idr, ac->id);
+		spin_unlock(&nd->async_copy_lock);
+		goto fail;
 	}
+
+	// the lookup pins are handed over to the worker, which drops them when the
+	// copy finishes - MEM_FREE and the per pid cleanup can not pull the memory
+	// out from under the transfer
+	queue_work(nd->async_copy_wq, &ac->work);
+	trace_ioctl_mem_copy(nd, src_mc, dst_mc);
 	return 0;
+
+fail:
+	ncdev_async_copy_free(ac);
+put:
+	mc_put(dst_mc);
+	mc_put(src_mc);
+	return ret;
 }
 
-static int ncdev_mem_get_pa(void *param)
+static int ncdev_mem_copy_async_status(struct neuron_device *nd, void *param)
 {
-	struct neuron_ioctl_mem_get_pa mem_get_pa_arg;
-	struct mem_chunk *mc;
-	u64 pa;
+	struct neuron_ioctl_mem_copy_async_status arg;
+	struct ncdev_async_copy *ac;
+	int status = -EBUSY;
 	int ret;
 
-	ret = copy_from_user(&mem_get_pa_arg, (struct neuron_ioctl_mem_get_pa *)param,
-			     sizeof(mem_get_pa_arg));
+	ret = copy_from_user(&arg, (struct neuron_ioctl_mem_copy_async_status *)param,
+			     sizeof(arg));
 	if (ret)
 		return ret;
 
-	mc = ncdev_mem_handle_to_mem_chunk(mem_get_pa_arg.mem_handle);
-	if (mc->mem_location == MEM_LOC_HOST)
-		pa = mc->pa | PCIEX8_0_BASE;
-	else
-		pa = mc->pa;
-	return copy_to_user(mem_get_pa_arg.pa, &pa, sizeof(u64));
+	spin_lock(&nd->async_copy_lock);
+	ac = idr_find(&nd->async_copy_idr, (int)arg.transfer_id);
+	if (ac) {
+		status = ac->status;
+		if (status != -EBUSY) // completed transfers are reaped on first query
+			idr_remove(&nd->async_copy_idr, ac->id);
+	}
+	spin_unlock(&nd->async_copy_lock);
+	if (ac == NULL)
+		return -ENOENT;
+	if (status != -EBUSY)
+		ncdev_async_copy_free(ac);
+
+	arg.status = status;
+	return copy_to_user(param, &arg, sizeof(arg));
 }
 
-static int ncdev_mem_free(struct neuron_device *nd, void *param)
+/* Waits for all in flight async copies and frees the unreaped ones. Must be called before
+ * the memory backing the transfers goes away.
+ */
+static void ncdev_async_copy_drain(struct neuron_device *nd)
+{
+	struct ncdev_async_copy *ac;
+	int id;
+
+	if (nd->async_copy_wq == NULL)
+		return;
+	flush_workqueue(nd->async_copy_wq);
+	spin_lock(&nd->async_copy_lock);
+	idr_for_each_entry(&nd->async_copy_idr, ac, id) {
+		idr_remove(&nd->async_copy_idr, id);
+		ncdev_async_copy_free(ac);
+	}
+	spin_unlock(&nd->async_copy_lock);
+}
+
+/* only one process can do discovery at a time */
+static DEFINE_MUTEX(ncdev_discovery_lock);
+
+/* discover and cache the east/west topology; caller must hold ncdev_discovery_lock */
+static int ncdev_discover_topology(struct neuron_device *nd)
 {
-	struct neuron_ioctl_mem_free mem_free_arg;
-	struct mem_chunk *mc;
 	int ret;
 
-	ret = copy_from_user(&mem_free_arg, (struct neuron_ioctl_mem_free *)param,
-			     sizeof(mem_free_arg));
+	if (nd->connected_device_count > 0)
+		return 0;
+	ret = fw_io_topology(nd->fw_io_ctx, nd->connected_devices, nd->connected_device_bases,
+			     &nd->connected_device_count);
 	if (ret)
-		return ret;
-	mc = ncdev_mem_handle_to_mem_chunk(mem_free_arg.mem_handle);
-	trace_ioctl_mem_alloc(nd, mc);
-	mc_free(&mc);
+		return -EFAULT;
 	return 0;
 }
 
-static int ncdev_mem_copy(struct neuron_device *nd, void *param)
+static int ncdev_mem_copy_p2p(struct neuron_device *nd, void *param)
 {
-	struct neuron_ioctl_mem_copy arg;
+	struct neuron_ioctl_mem_copy_p2p arg;
+	struct neuron_device *peer_nd;
 	struct mem_chunk *src_mc;
 	struct mem_chunk *dst_mc;
 	int ret;
 
-	ret = copy_from_user(&arg, (struct neuron_ioctl_mem_copy *)param, sizeof(arg));
+	ret = copy_from_user(&arg, (struct neuron_ioctl_mem_copy_p2p *)param, sizeof(arg));
+	if (ret)
+		return ret;
+	peer_nd = neuron_pci_get_device(arg.dst_device);
+	if (peer_nd == NULL) {
+		pr_err("invalid peer device index %u\n", arg.dst_device);
+		return -ENODEV;
+	}
+	// topology might not be discovered yet if the app never asked for DEVICE_INFO
+	mutex_lock(&ncdev_discovery_lock);
+	ret = ncdev_discover_topology(nd);
+	mutex_unlock(&ncdev_discovery_lock);
 	if (ret)
 		return ret;
-	src_mc = ncdev_mem_handle_to_mem_chunk(arg.src_mem_handle);
-	dst_mc = ncdev_mem_handle_to_mem_chunk(arg.dst_mem_handle);
+	src_mc = ncdev_mem_handle_to_mem_chunk(nd, arg.src_mem_handle);
+	dst_mc = ncdev_mem_handle_to_mem_chunk(peer_nd, arg.dst_mem_handle);
+	if (src_mc == NULL || dst_mc == NULL) {
+		ret = -EINVAL;
+		goto put;
+	}
+	// only the peer's device DRAM is reachable through the east/west window
+	if (dst_mc->mem_location != MEM_LOC_DEVICE) {
+		pr_err("dst mem handle is not device memory\n");
+		ret = -EINVAL;
+		goto put;
+	}
 	// check access is within the range.
 	if (arg.src_offset + arg.size > src_mc->size) {
 		pr_err("src offset+size is too large for mem handle\n");
-		return -EINVAL;
+		ret = -EINVAL;
+		goto put;
 	}
 	// check access is within the range.
 	if (arg.dst_offset + arg.size > dst_mc->size) {
-		pr_err("src offset+size is too large for mem handle\n");
-		return -EINVAL;
+		pr_err("dst offset+size is too large for mem handle\n");
+		ret = -EINVAL;
+		goto put;
 	}
-	ret = ndma_memcpy_mc(nd, src_mc, dst_mc, arg.src_offset, arg.dst_offset, arg.size);
+	ret = ndma_memcpy_p2p(nd, src_mc, arg.src_offset, arg.dst_device,
+			      dst_mc->pa + arg.dst_offset, arg.size);
 	if (ret) {
-		pr_err("dma memcpy failed\n");
-		return ret;
+		pr_err("p2p dma memcpy failed\n");
+		goto put;
 	}
 	trace_ioctl_mem_copy(nd, src_mc, dst_mc);
-	return 0;
+put:
+	mc_put(dst_mc);
+	mc_put(src_mc);
+	return ret;
 }
 
 int ncdev_mem_buf_copy(struct neuron_device *nd, void *param)
@@ -374,10 +1158,18 @@ int ncdev_mem_buf_copy(struct neuron_device *nd, void *param)
 	ret = copy_from_user(&arg, (struct neuron_ioctl_mem_buf_copy *)param, sizeof(arg));
 	if (ret)
 		return ret;
-	mc = ncdev_mem_handle_to_mem_chunk(arg.mem_handle);
+	mc = ncdev_mem_handle_to_mem_chunk(nd, arg.mem_handle);
+	if (mc == NULL)
+		return -EINVAL;
+	// registered user memory(no kernel mapping) is already accessible to the application
+	if (mc->pages && mc->va == NULL) {
+		mc_put(mc);
+		return -EINVAL;
+	}
 	// check access is within the range.
 	if (arg.offset + arg.size > mc->size) {
 		pr_err("offset+size is too large for mem handle\n");
+		mc_put(mc);
 		return -EINVAL;
 	}
 
@@ -392,6 +1184,7 @@ int ncdev_mem_buf_copy(struct neuron_device *nd, void *param)
 		} else {
 			ret = copy_to_user(arg.buffer, mc->va + arg.offset, arg.size);
 		}
+		mc_put(mc);
 		return ret;
 	} else {
 		// TODO - this has to be converted to mmap
@@ -399,9 +1192,9 @@ int ncdev_mem_buf_copy(struct neuron_device *nd, void *param)
 		u32 offset = 0;
 		int remaining = arg.size;
 		u32 copy_size = 0;
-		ret = mc_alloc(&nd->mpset, &src_mc, MAX_DMA_DESC_SIZE, MEM_LOC_HOST, 0, 0,
-			       mc->nc_id);
+		ret = mc_stage_get(&nd->mpset, &src_mc, MAX_DMA_DESC_SIZE, mc->nc_id);
 		if (ret) {
+			mc_put(mc);
 			ret = -ENOMEM;
 			return ret;
 		}
@@ -431,9 +1224,151 @@ int ncdev_mem_buf_copy(struct neuron_device *nd, void *param)
 			remaining -= copy_size;
 			offset += copy_size;
 		}
-		mc_free(&src_mc);
+		mc_stage_put(&src_mc);
+		mc_put(mc);
+		return ret;
+	}
+}
+
+/**
+ * Copy one buffer to/from a device chunk in MAX_DMA_DESC_SIZE slices through the given
+ * staging buffer. Same loop as ncdev_mem_buf_copy(), but with the staging buffer supplied
+ * by the caller so one buffer serves a whole batch.
+ */
+static int ncdev_mem_buf_copy_chunked(struct neuron_device *nd, struct mem_chunk *stage_mc,
+				      struct mem_chunk *mc, void *buffer, u32 offset, u32 size,
+				      u32 copy_to_mem_handle)
+{
+	u32 copied = 0;
+	int ret = 0;
+
+	while (copied < size) {
+		u32 copy_size = min_t(u32, size - copied, MAX_DMA_DESC_SIZE);
+		if (copy_to_mem_handle) {
+			ret = copy_from_user(stage_mc->va, buffer + copied, copy_size);
+			if (ret)
+				break;
+			ret = ndma_memcpy_buf_to_mc(nd, stage_mc->va, 0, mc, offset + copied,
+						    copy_size);
+			if (ret)
+				break;
+		} else {
+			ret = ndma_memcpy_buf_from_mc(nd, stage_mc->va, 0, mc, offset + copied,
+						      copy_size);
+			if (ret)
+				break;
+			ret = copy_to_user(buffer + copied, stage_mc->va, copy_size);
+			if (ret)
+				break;
+		}
+		copied += copy_size;
+	}
+	return ret;
+}
+
+static int ncdev_mem_buf_copy_sg(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_mem_buf_copy_sg arg;
+	struct neuron_ioctl_mem_buf_copy_entry *entries = NULL;
+	struct mem_chunk *stage_mc = NULL;
+	// pack state - writes to adjacent device ranges accumulate in the staging
+	// buffer and go out as a single DMA transfer
+	struct mem_chunk *pack_mc = NULL;
+	u32 pack_offset = 0, pack_used = 0;
+	u32 i;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_mem_buf_copy_sg *)param, sizeof(arg));
+	if (ret)
 		return ret;
+	if (arg.count == 0 || arg.count > NEURON_MEM_BUF_COPY_SG_MAX_ENTRIES)
+		return -EINVAL;
+
+	entries = kvmalloc(arg.count * sizeof(*entries), GFP_KERNEL);
+	if (entries == NULL)
+		return -ENOMEM;
+	ret = copy_from_user(entries, arg.entries, arg.count * sizeof(*entries));
+	if (ret)
+		goto done;
+
+	ret = mc_stage_get(&nd->mpset, &stage_mc, MAX_DMA_DESC_SIZE, 0);
+	if (ret)
+		goto done;
+
+	for (i = 0; i < arg.count; i++) {
+		struct neuron_ioctl_mem_buf_copy_entry *e = &entries[i];
+		struct mem_chunk *mc = ncdev_mem_handle_to_mem_chunk(nd, e->mem_handle);
+		// set when the lookup pin is handed over to the pack state
+		bool mc_packed = false;
+
+		if (mc == NULL || (mc->pages && mc->va == NULL) ||
+		    e->offset + e->size > mc->size) {
+			mc_put(mc);
+			ret = -EINVAL;
+			break;
+		}
+		if (e->copy_to_mem_handle)
+			trace_ioctl_mem_copyin(nd, mc, e->buffer, e->offset, e->size);
+		else
+			trace_ioctl_mem_copyout(nd, mc, e->buffer, e->offset, e->size);
+
+		// an entry that can not join the current pack pushes it out first; this
+		// also keeps reads ordered behind a pending packed write
+		if (pack_used &&
+		    (!e->copy_to_mem_handle || mc != pack_mc ||
+		     e->offset != pack_offset + pack_used ||
+		     pack_used + e->size > MAX_DMA_DESC_SIZE)) {
+			ret = ndma_memcpy_buf_to_mc(nd, stage_mc->va, 0, pack_mc, pack_offset,
+						    pack_used);
+			if (ret) {
+				mc_put(mc);
+				break;
+			}
+			mc_put(pack_mc);
+			pack_mc = NULL;
+			pack_used = 0;
+		}
+
+		if (mc->mem_location == MEM_LOC_HOST) {
+			if (e->copy_to_mem_handle)
+				ret = copy_from_user(mc->va + e->offset, e->buffer, e->size);
+			else
+				ret = copy_to_user(e->buffer, mc->va + e->offset, e->size);
+			if (ret) {
+				mc_put(mc);
+				break;
+			}
+		} else if (e->copy_to_mem_handle && e->size <= MAX_DMA_DESC_SIZE) {
+			ret = copy_from_user(stage_mc->va + pack_used, e->buffer, e->size);
+			if (ret) {
+				mc_put(mc);
+				break;
+			}
+			if (pack_used == 0) {
+				pack_mc = mc;
+				pack_offset = e->offset;
+				mc_packed = true;
+			}
+			pack_used += e->size;
+		} else {
+			ret = ncdev_mem_buf_copy_chunked(nd, stage_mc, mc, e->buffer, e->offset,
+							 e->size, e->copy_to_mem_handle);
+			if (ret) {
+				mc_put(mc);
+				break;
+			}
+		}
+		if (!mc_packed)
+			mc_put(mc);
 	}
+	if (ret == 0 && pack_used)
+		ret = ndma_memcpy_buf_to_mc(nd, stage_mc->va, 0, pack_mc, pack_offset, pack_used);
+	mc_put(pack_mc);
+
+	mc_stage_put(&stage_mc);
+done:
+	kvfree(entries);
+	return ret;
 }
 
 static long ncdev_semaphore_ioctl(struct neuron_device *nd, unsigned int cmd, void *param)
@@ -444,6 +1379,8 @@ static long ncdev_semaphore_ioctl(struct neuron_device *nd, unsigned int cmd, vo
 	ret = copy_from_user(&arg, (struct neuron_ioctl_semaphore *)param, sizeof(arg));
 	if (ret)
 		return ret;
+	if (!ncdev_pid_owns_nc(nd, arg.nc_id))
+		return -EACCES;
 	if (cmd == NEURON_IOCTL_SEMAPHORE_READ) {
 		ret = nc_semaphore_read(nd, arg.nc_id, arg.semaphore_index, &arg.value);
 		if (ret)
@@ -459,6 +1396,87 @@ static long ncdev_semaphore_ioctl(struct neuron_device *nd, unsigned int cmd, vo
 	return -1;
 }
 
+static long ncdev_semaphore_event_batch(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_semaphore_event_batch arg;
+	struct neuron_ioctl_sync_op *ops;
+	u32 i;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_semaphore_event_batch *)param,
+			     sizeof(arg));
+	if (ret)
+		return ret;
+	if (arg.count == 0 || arg.count > NEURON_SEMAPHORE_EVENT_BATCH_MAX_OPS)
+		return -EINVAL;
+
+	ops = kvmalloc(arg.count * sizeof(*ops), GFP_KERNEL);
+	if (ops == NULL)
+		return -ENOMEM;
+	ret = copy_from_user(ops, arg.ops, arg.count * sizeof(*ops));
+	if (ret)
+		goto done;
+
+	for (i = 0; i < arg.count; i++) {
+		struct neuron_ioctl_sync_op *op = &ops[i];
+
+		if (op->nc_id >= V1_NC_PER_DEVICE) {
+			ret = -EINVAL;
+			goto done;
+		}
+		if (!ncdev_pid_owns_nc(nd, op->nc_id)) {
+			ret = -EACCES;
+			goto done;
+		}
+		switch (op->op) {
+		case NEURON_SYNC_OP_SEMAPHORE_READ:
+			ret = nc_semaphore_read(nd, op->nc_id, op->index, &op->value);
+			break;
+		case NEURON_SYNC_OP_SEMAPHORE_WRITE:
+			ret = nc_semaphore_write(nd, op->nc_id, op->index, op->value);
+			break;
+		case NEURON_SYNC_OP_SEMAPHORE_INCREMENT:
+			ret = nc_semaphore_increment(nd, op->nc_id, op->index, op->value);
+			break;
+		case NEURON_SYNC_OP_SEMAPHORE_DECREMENT:
+			ret = nc_semaphore_decrement(nd, op->nc_id, op->index, op->value);
+			break;
+		case NEURON_SYNC_OP_EVENT_GET:
+			ret = nc_event_get(nd, op->nc_id, op->index, &op->value);
+			break;
+		case NEURON_SYNC_OP_EVENT_SET:
+			ret = nc_event_set(nd, op->nc_id, op->index, op->value);
+			break;
+		default:
+			ret = -EINVAL;
+			break;
+		}
+		if (ret)
+			goto done;
+	}
+	// hand the values read back to the application
+	ret = copy_to_user(arg.ops, ops, arg.count * sizeof(*ops));
+done:
+	kvfree(ops);
+	return ret;
+}
+
+static long ncdev_sync_mmap_offset(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_sync_mmap_offset arg;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_sync_mmap_offset *)param, sizeof(arg));
+	if (ret)
+		return ret;
+	if (!ncdev_pid_owns_nc(nd, arg.nc_id))
+		return -EACCES;
+	ret = nc_get_sync_mmap_offset(arg.nc_id, &arg.mmap_offset);
+	if (ret)
+		return ret;
+	return copy_to_user((struct neuron_ioctl_sync_mmap_offset *)param, &arg, sizeof(arg));
+}
+
 static long ncdev_events_ioctl(struct neuron_device *nd, unsigned int cmd, void *param)
 {
 	int ret;
@@ -469,6 +1487,8 @@ static long ncdev_events_ioctl(struct neuron_device *nd, unsigned int cmd, void
 	if (ret)
 		return ret;
 
+	if (!ncdev_pid_owns_nc(nd, arg.nc_id))
+		return -EACCES;
 	if (cmd == NEURON_IOCTL_EVENT_GET) {
 		ret = nc_event_get(nd, arg.nc_id, arg.event_index, &arg.value);
 		if (ret) {
@@ -503,17 +1523,17 @@ static long ncdev_bar_read(struct neuron_device *nd, u8 bar, u64 *reg_addresses,
 		u32 nc_id = 0;
 		dma_addr_t src_addr = reg_addresses[0];
 
-		ret = mc_alloc(&nd->mpset, &mc, data_size, MEM_LOC_HOST, 0, 0, nc_id);
+		ret = mc_stage_get(&nd->mpset, &mc, data_size, nc_id);
 		if (ret)
 			return -ENOMEM;
 
 		ret = ndma_memcpy(nd, mc->nc_id, src_addr, mc->pa | PCIEX8_0_BASE, data_size);
 		if (ret) {
-			mc_free(&mc);
+			mc_stage_put(&mc);
 			return ret;
 		}
 		ret = copy_to_user(user_va, mc->va, data_size);
-		mc_free(&mc);
+		mc_stage_put(&mc);
 	}
 	return ret;
 }
@@ -546,16 +1566,21 @@ static long ncdev_bar_write(struct neuron_device *nd, u8 bar, u64 *reg_addresses
 			}
 			writel(data[i], nd->npdev.bar0 + off);
 		}
+		// written registers may be sitting in the CSR read cache
+		fw_io_csr_cache_invalidate(nd->fw_io_ctx);
 	} else {
-		int i;
 		u64 off = reg_addresses[0] - (u64)nd->npdev.bar2;
-		for (i = 0; i < data_count; i++, off += sizeof(u32)) {
-			if (off > nd->npdev.bar2_size) {
-				ret = -EINVAL;
-				goto done;
-			}
-			writel(data[i], nd->npdev.bar2 + off);
+		if (off > nd->npdev.bar2_size || data_size > nd->npdev.bar2_size - off) {
+			ret = -EINVAL;
+			goto done;
 		}
+		/*
+		 * BAR2 writes push sequential data(descriptors, engine configuration),
+		 * so burst them instead of issuing one ordered PCIe write per word.
+		 * The read-back orders the burst against anything the caller does next.
+		 */
+		memcpy_toio(nd->npdev.bar2 + off, data, data_size);
+		readl(nd->npdev.bar2 + off);
 	}
 done:
 	kfree(data);
@@ -658,6 +1683,7 @@ done:
 
 static long ncdev_device_reset(struct neuron_device *nd)
 {
+	fw_io_csr_cache_invalidate(nd->fw_io_ctx);
 	fw_io_initiate_reset(nd->npdev.bar0);
 	return 0;
 }
@@ -680,8 +1706,6 @@ static long ncdev_device_ready(struct neuron_device *nd, void *param)
 	return copy_to_user(param, &result, 1);
 }
 
-/* only one process can do discovery at a time */
-static DEFINE_MUTEX(ncdev_discovery_lock);
 static long ncdev_device_info(struct neuron_device *nd, void *param)
 {
 	int i, ret;
@@ -706,14 +1730,9 @@ static long ncdev_device_info(struct neuron_device *nd, void *param)
 	pci_write_config_word(nd->pdev, PCI_COMMAND, PCI_COMMAND_MASTER | PCI_COMMAND_MEMORY);
 
 	// if topology discovery is not yet done, do it and cache the result
-	if (nd->connected_device_count <= 0) {
-		ret = fw_io_topology(nd->fw_io_ctx, nd->connected_devices,
-				     &nd->connected_device_count);
-		if (ret) {
-			ret = -EFAULT;
-			goto out;
-		}
-	}
+	ret = ncdev_discover_topology(nd);
+	if (ret)
+		goto out;
 
 	for (i = 0; i < nd->connected_device_count; i++) {
 		result.connected_devices[i] = nd->connected_devices[i];
@@ -731,29 +1750,50 @@ out:
 	return ret;
 }
 
-/* Only one process can take ownership of a device. */
-static DEFINE_MUTEX(ncdev_device_lock);
+static long ncdev_device_numa_node(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_device_numa_node arg;
+
+	arg.numa_node = nd->mpset.numa_node;
+	return copy_to_user((struct neuron_ioctl_device_numa_node *)param, &arg, sizeof(arg));
+}
+
 static long ncdev_device_init(struct neuron_device *nd, void *param)
 {
 	int ret = 0;
+	int nc_id;
 	struct neuron_ioctl_device_init arg;
 	u64 device_dram_addr[V1_MAX_DRAM_CHANNELS] = { P_0_DRAM_0_BASE, P_0_DRAM_1_BASE };
 	u64 device_dram_size[V1_MAX_DRAM_CHANNELS] = { P_0_DRAM_0_SIZE, P_0_DRAM_1_SIZE };
 
-	mutex_lock(&ncdev_device_lock);
 	ret = copy_from_user(&arg, (struct neuron_ioctl_device_init *)param, sizeof(arg));
 	if (ret) {
 		return ret;
 	}
 
+	mutex_lock(&ncdev_device_lock);
 	if (nd->current_pid == 0) {
-		ret = mpset_device_init(&nd->mpset, V1_MAX_DRAM_CHANNELS, arg.mem_regions,
-					device_dram_addr, device_dram_size);
-		if (ret)
-			goto done;
+		// a whole device claim excludes core level sharing
+		for (nc_id = 0; nc_id < V1_NC_PER_DEVICE; nc_id++) {
+			if (nd->nc_pid[nc_id] != 0 &&
+			    nd->nc_pid[nc_id] != task_tgid_nr(current)) {
+				pr_err("nc%d inuse by pid:%d\n", nc_id, nd->nc_pid[nc_id]);
+				ret = -EBUSY;
+				goto done;
+			}
+		}
+		// the mpset and DMA are already set up when this process claimed cores before
+		if (nd->mpset.num_regions == 0) {
+			ret = mpset_device_init(&nd->mpset, V1_MAX_DRAM_CHANNELS, arg.mem_regions,
+						device_dram_addr, device_dram_size);
+			if (ret)
+				goto done;
+			ret = ndmar_init(nd);
+			if (ret)
+				goto done;
+		}
 		nd->current_pid = task_tgid_nr(current);
 		nd->current_pid_open_count = 1; //since the ioctl done after open set to 1
-		ret = ndmar_init(nd);
 	} else if (nd->current_pid != task_tgid_nr(current)) {
 		pr_err("device inuse by pid:%d\n", nd->current_pid);
 		ret = -EBUSY;
@@ -764,20 +1804,90 @@ done:
 	return ret;
 }
 
+static long ncdev_nc_claim(struct neuron_device *nd, void *param)
+{
+	int ret = 0;
+	struct neuron_ioctl_nc_claim arg;
+	u64 device_dram_addr[V1_MAX_DRAM_CHANNELS] = { P_0_DRAM_0_BASE, P_0_DRAM_1_BASE };
+	u64 device_dram_size[V1_MAX_DRAM_CHANNELS] = { P_0_DRAM_0_SIZE, P_0_DRAM_1_SIZE };
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_nc_claim *)param, sizeof(arg));
+	if (ret) {
+		return ret;
+	}
+	if (arg.nc_id >= V1_NC_PER_DEVICE) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&ncdev_device_lock);
+	if (nd->current_pid != 0 && nd->current_pid != task_tgid_nr(current)) {
+		pr_err("device inuse by pid:%d\n", nd->current_pid);
+		ret = -EBUSY;
+		goto done;
+	}
+	if (nd->nc_pid[arg.nc_id] != 0 && nd->nc_pid[arg.nc_id] != task_tgid_nr(current)) {
+		pr_err("nc%d inuse by pid:%d\n", arg.nc_id, nd->nc_pid[arg.nc_id]);
+		ret = -EBUSY;
+		goto done;
+	}
+	// the first claim brings the device up with one memory region per core, so
+	// each owning process allocates from its own arena
+	if (nd->mpset.num_regions == 0) {
+		ret = mpset_device_init(&nd->mpset, V1_MAX_DRAM_CHANNELS, V1_NC_PER_DEVICE,
+					device_dram_addr, device_dram_size);
+		if (ret)
+			goto done;
+		ret = ndmar_init(nd);
+		if (ret)
+			goto done;
+	}
+	WRITE_ONCE(nd->nc_pid[arg.nc_id], task_tgid_nr(current));
+
+done:
+	mutex_unlock(&ncdev_device_lock);
+	return ret;
+}
+
 static long ncdev_device_release(struct ncdev *dev, struct neuron_device *nd)
 {
 	int ret = 0;
+	int nc_id;
+	bool nc_released = false;
+
 	mutex_lock(&ncdev_device_lock);
 
 	if ((nd->current_pid_open_count == 0) && ((nd->current_pid == task_tgid_nr(current)) || nd->current_pid == task_ppid_nr(current))) {
 		nd->current_pid = 0;
 	}
 
+	// release the per core claims of the closing process and free what it
+	// allocated - the other core owners keep running undisturbed
+	for (nc_id = 0; nc_id < V1_NC_PER_DEVICE; nc_id++) {
+		if (nd->nc_pid[nc_id] == task_tgid_nr(current) ||
+		    nd->nc_pid[nc_id] == task_ppid_nr(current)) {
+			nc_nq_destroy_nc(nd, nc_id);
+			WRITE_ONCE(nd->nc_pid[nc_id], 0);
+			nc_released = true;
+		}
+	}
+	if (nc_released && dev->open_count != 0) {
+		// let in flight async copies finish before freeing the closing
+		// process's chunks(entries stay in the idr for their submitters)
+		if (nd->async_copy_wq)
+			flush_workqueue(nd->async_copy_wq);
+		// drop the mmap slots first so none of them outlives its chunk
+		ncdev_mc_mmap_forget_pid(dev, task_tgid_nr(current));
+		mpset_free_pid(&nd->mpset, task_tgid_nr(current));
+	}
+
 	if (dev->open_count == 0) {
+		ncdev_async_copy_drain(nd);
+		ncdev_dma_program_drop_all(nd);
 		nc_nq_destroy_all(nd);
 		ndmar_close(nd);
 		mpset_free_all(&nd->mpset);
 		nd->mpset.num_regions = 0;
+		ncdev_mc_mmap_forget(dev, NULL);
 	}
 
 	mutex_unlock(&ncdev_device_lock);
@@ -799,6 +1909,9 @@ static long ncdev_nc_nq_init(struct neuron_device *nd, void *param)
 		return ret;
 	}
 
+	if (!ncdev_pid_owns_nc(nd, arg.nc_id)) {
+		return -EACCES;
+	}
 	ret = nc_nq_init(nd, arg.nc_id, arg.engine_index, arg.nq_type, arg.size);
 	if (ret) {
 		return ret;
@@ -825,9 +1938,29 @@ static long ncdev_nc_nq_destroy(struct neuron_device *nd, void *param)
 	if (ret) {
 		return ret;
 	}
+	if (!ncdev_pid_owns_nc(nd, nc_id)) {
+		return -EACCES;
+	}
 	return nc_nq_destroy(nd, nc_id, eng_index, nq_type);
 }
 
+static long ncdev_nc_nq_watch(struct neuron_device *nd, void *param)
+{
+	struct neuron_ioctl_notifications_watch arg;
+	int ret;
+
+	ret = copy_from_user(&arg, (struct neuron_ioctl_notifications_watch *)param, sizeof(arg));
+	if (ret) {
+		return ret;
+	}
+
+	if (!ncdev_pid_owns_nc(nd, arg.nc_id)) {
+		return -EACCES;
+	}
+	return nc_nq_watch_arm(nd, arg.nc_id, arg.engine_index, arg.nq_type, arg.read_offset,
+			       arg.watch != 0);
+}
+
 long ncdev_ioctl(struct file *filep, unsigned int cmd, unsigned long param)
 {
 	struct ncdev *ncd;
@@ -841,16 +1974,32 @@ long ncdev_ioctl(struct file *filep, unsigned int cmd, unsigned long param)
 	if (nd == NULL) {
 		return -EINVAL;
 	}
-	// the following IOCTL allowed only for the process which did DEVICE_INIT
-	if (cmd == NEURON_IOCTL_DEVICE_RESET || cmd == NEURON_IOCTL_DEVICE_RESET_STATUS ||
-	    cmd == NEURON_IOCTL_DMA_ENG_INIT || cmd == NEURON_IOCTL_DMA_ENG_SET_STATE ||
+	// reset affects every core, so only a whole device owner may ask for it
+	if (cmd == NEURON_IOCTL_DEVICE_RESET || cmd == NEURON_IOCTL_DEVICE_RESET_STATUS) {
+		if (nd->current_pid != task_tgid_nr(current)) {
+			return -EACCES;
+		}
+	}
+	// the following IOCTL allowed only for a process which did DEVICE_INIT or
+	// claimed at least one core with NC_CLAIM
+	if (cmd == NEURON_IOCTL_DMA_ENG_INIT || cmd == NEURON_IOCTL_DMA_ENG_SET_STATE ||
 	    cmd == NEURON_IOCTL_DMA_QUEUE_INIT || cmd == NEURON_IOCTL_DMA_ACK_COMPLETED ||
 	    cmd == NEURON_IOCTL_DMA_QUEUE_RELEASE || cmd == NEURON_IOCTL_DMA_COPY_DESCRIPTORS ||
+	    cmd == NEURON_IOCTL_DMA_SUBMIT_BATCH || cmd == NEURON_IOCTL_DMA_BENCHMARK ||
+	    cmd == NEURON_IOCTL_DMA_PROGRAM_REGISTER || cmd == NEURON_IOCTL_DMA_PROGRAM_TRIGGER ||
+	    cmd == NEURON_IOCTL_DMA_PROGRAM_UNREGISTER ||
 	    cmd == NEURON_IOCTL_MEM_ALLOC || cmd == NEURON_IOCTL_MEM_FREE ||
-	    cmd == NEURON_IOCTL_MEM_COPY || cmd == NEURON_IOCTL_MEM_GET_PA ||
+	    cmd == NEURON_IOCTL_MEM_REGISTER ||
+	    cmd == NEURON_IOCTL_MEM_COPY || cmd == NEURON_IOCTL_MEM_COPY_P2P ||
+	    cmd == NEURON_IOCTL_MEM_COPY_ASYNC || cmd == NEURON_IOCTL_MEM_COPY_ASYNC_STATUS ||
+	    cmd == NEURON_IOCTL_MEM_GET_PA ||
+	    cmd == NEURON_IOCTL_MEM_GET_MMAP_OFFSET ||
 	    cmd == NEURON_IOCTL_BAR_WRITE || cmd == NEURON_IOCTL_POST_METRIC ||
-	    cmd == NEURON_IOCTL_NOTIFICATIONS_INIT || cmd == NEURON_IOCTL_NOTIFICATIONS_DESTROY) {
-		if (nd->current_pid != task_tgid_nr(current)) {
+	    cmd == NEURON_IOCTL_NOTIFICATIONS_INIT || cmd == NEURON_IOCTL_NOTIFICATIONS_DESTROY ||
+	    cmd == NEURON_IOCTL_NOTIFICATIONS_WATCH) {
+		// the whole device owner or any per core owner may enter; handlers
+		// taking a core or engine id further check that core is owned
+		if (!ncdev_pid_owns_any(nd)) {
 			return -EACCES;
 		}
 	}
@@ -863,12 +2012,16 @@ long ncdev_ioctl(struct file *filep, unsigned int cmd, unsigned long param)
 		return ncdev_device_ready(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_DEVICE_INFO) {
 		return ncdev_device_info(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_DEVICE_NUMA_NODE) {
+		return ncdev_device_numa_node(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_DEVICE_INIT) {
 		return ncdev_device_init(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_DEVICE_RELEASE) {
 		return ncdev_device_release(ncd, nd);
 	} else if (cmd == NEURON_IOCTL_DEVICE_APP_PID) {
 		return ncdev_device_app_pid(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_NC_CLAIM) {
+		return ncdev_nc_claim(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_DMA_ENG_INIT) {
 		return ncdev_dma_engine_init(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_DMA_ENG_SET_STATE) {
@@ -883,22 +2036,46 @@ long ncdev_ioctl(struct file *filep, unsigned int cmd, unsigned long param)
 		return ncdev_dma_queue_release(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_DMA_COPY_DESCRIPTORS) {
 		return ncdev_dma_copy_descriptors(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_DMA_SUBMIT_BATCH) {
+		return ncdev_dma_submit_batch(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_DMA_PROGRAM_REGISTER) {
+		return ncdev_dma_program_register(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_DMA_PROGRAM_TRIGGER) {
+		return ncdev_dma_program_trigger(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_DMA_PROGRAM_UNREGISTER) {
+		return ncdev_dma_program_unregister(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_DMA_ENG_GET_STATE) {
 		return ncdev_dma_engine_get_state(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_DMA_QUEUE_GET_STATE) {
 		return ncdev_dma_queue_get_state(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_DMA_ENG_SNAPSHOT) {
+		return ncdev_dma_eng_snapshot(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_DMA_BENCHMARK) {
+		return ncdev_dma_benchmark(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_DMA_DESCRIPTOR_COPYOUT) {
 		return ncdev_dma_descriptor_copyout(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_MEM_ALLOC) {
 		return ncdev_mem_alloc(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_MEM_REGISTER) {
+		return ncdev_mem_register(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_MEM_GET_PA) {
-		return ncdev_mem_get_pa((void *)param);
+		return ncdev_mem_get_pa(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_MEM_FREE) {
 		return ncdev_mem_free(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_MEM_GET_MMAP_OFFSET) {
+		return ncdev_mem_get_mmap_offset(ncd, nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_MEM_COPY) {
 		return ncdev_mem_copy(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_MEM_COPY_ASYNC) {
+		return ncdev_mem_copy_async(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_MEM_COPY_ASYNC_STATUS) {
+		return ncdev_mem_copy_async_status(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_MEM_COPY_P2P) {
+		return ncdev_mem_copy_p2p(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_MEM_BUF_COPY) {
 		return ncdev_mem_buf_copy(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_MEM_BUF_COPY_SG) {
+		return ncdev_mem_buf_copy_sg(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_SEMAPHORE_READ) {
 		return ncdev_semaphore_ioctl(nd, cmd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_SEMAPHORE_WRITE) {
@@ -911,6 +2088,10 @@ long ncdev_ioctl(struct file *filep, unsigned int cmd, unsigned long param)
 		return ncdev_events_ioctl(nd, cmd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_EVENT_SET) {
 		return ncdev_events_ioctl(nd, cmd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_SEMAPHORE_EVENT_BATCH) {
+		return ncdev_semaphore_event_batch(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_SYNC_MMAP_OFFSET) {
+		return ncdev_sync_mmap_offset(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_BAR_READ) {
 		return ncdev_bar_rw(nd, (void *)param, true);
 	} else if (cmd == NEURON_IOCTL_BAR_WRITE) {
@@ -921,6 +2102,8 @@ long ncdev_ioctl(struct file *filep, unsigned int cmd, unsigned long param)
 		return ncdev_nc_nq_init(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_NOTIFICATIONS_DESTROY) {
 		return ncdev_nc_nq_destroy(nd, (void *)param);
+	} else if (cmd == NEURON_IOCTL_NOTIFICATIONS_WATCH) {
+		return ncdev_nc_nq_watch(nd, (void *)param);
 	} else if (cmd == NEURON_IOCTL_READ_HW_COUNTERS) {
 		return ncdev_read_hw_counters(nd, (void *)param);
 	} else {
@@ -980,11 +2163,39 @@ static int ncdev_mmap(struct file *filep, struct vm_area_struct *vma)
 	}
 	offset = vma->vm_pgoff * PAGE_SIZE;
 	ret = nc_get_nq_from_mmap_offset(offset, &nc_id, &eng_index, &nq_type);
-	if (ret) {
-		return ret;
+	if (ret == 0) {
+		if (!ncdev_pid_owns_nc(nd, nc_id))
+			return -EACCES;
+		return nc_nq_mmap(nd, nc_id, eng_index, nq_type, vma);
+	}
+
+	ret = nc_get_sync_from_mmap_offset(offset, &nc_id);
+	if (ret == 0) {
+		if (!ncdev_pid_owns_nc(nd, nc_id))
+			return -EACCES;
+		return nc_sync_mmap(nd, nc_id, vma);
+	}
+
+	/* not a notification queue - map a mem chunk registered via MEM_GET_MMAP_OFFSET */
+	return ncdev_mc_mmap(ncd, nd, offset, vma);
+}
+
+static unsigned int ncdev_poll(struct file *filep, poll_table *wait)
+{
+	struct ncdev *ncd;
+	struct neuron_device *nd;
+	unsigned int mask = 0;
+
+	ncd = filep->private_data;
+	if (ncd == NULL || ncd->ndev == NULL) {
+		return POLLERR;
 	}
+	nd = ncd->ndev;
 
-	return nc_nq_mmap(nd, nc_id, eng_index, nq_type, vma);
+	poll_wait(filep, &nd->nq_wait_queue, wait);
+	if (nc_nq_watch_fired(nd))
+		mask |= POLLIN | POLLRDNORM;
+	return mask;
 }
 
 static struct file_operations ncdev_fops = {
@@ -993,6 +2204,7 @@ static struct file_operations ncdev_fops = {
 	.release = ncdev_close,
 	.unlocked_ioctl = ncdev_ioctl,
 	.mmap = ncdev_mmap,
+	.poll = ncdev_poll,
 };
 
 #define NEURON_MAX_DEV_NAME 32
@@ -1006,12 +2218,22 @@ int ncdev_create_device_node(struct neuron_device *ndev)
 
 	snprintf(dev_name, sizeof(dev_name), "neuron%d", ndev->device_index);
 
+	idr_init(&ndev->async_copy_idr);
+	spin_lock_init(&ndev->async_copy_lock);
+	idr_init(&ndev->dma_prog_idr);
+	mutex_init(&ndev->dma_prog_lock);
+	ndev->async_copy_wq = alloc_workqueue("neuron%d_copy", WQ_UNBOUND, 0, ndev->device_index);
+	if (ndev->async_copy_wq == NULL)
+		return -ENOMEM;
+
 	minor = ndev->device_index;
 	devnodes[ndev->device_index].minor = minor;
 
 	devno = MKDEV(major, minor);
 	cdev = cdev_alloc();
 	if (cdev == NULL) {
+		destroy_workqueue(ndev->async_copy_wq);
+		ndev->async_copy_wq = NULL;
 		return -1;
 	}
 	cdev_init(cdev, &ncdev_fops);
@@ -1022,6 +2244,8 @@ int ncdev_create_device_node(struct neuron_device *ndev)
 	if (ret < 0) {
 		pr_err("failed to register character device %s\n", dev_name);
 		cdev_del(cdev);
+		destroy_workqueue(ndev->async_copy_wq);
+		ndev->async_copy_wq = NULL;
 		return -1;
 	}
 
@@ -1037,6 +2261,8 @@ int ncdev_create_device_node(struct neuron_device *ndev)
 		pr_err("error %d while trying to create %s\n", ret, dev_name);
 		device_destroy(neuron_dev_class, devno);
 		cdev_del(cdev);
+		destroy_workqueue(ndev->async_copy_wq);
+		ndev->async_copy_wq = NULL;
 		return ret;
 	}
 
@@ -1049,6 +2275,15 @@ int ncdev_delete_device_node(struct neuron_device *ndev)
 	int minor;
 	dev_t devno;
 
+	ncdev_async_copy_drain(ndev);
+	if (ndev->async_copy_wq) {
+		destroy_workqueue(ndev->async_copy_wq);
+		ndev->async_copy_wq = NULL;
+		idr_destroy(&ndev->async_copy_idr);
+	}
+	ncdev_dma_program_drop_all(ndev);
+	idr_destroy(&ndev->dma_prog_idr);
+
 	minor = devnodes[ndev->device_index].minor;
 	devno = MKDEV(major, minor);
 	device_destroy(neuron_dev_class, devno);
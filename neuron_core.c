@@ -34,6 +34,7 @@
 #include <linux/types.h>
 #include <linux/delay.h>
 #include <linux/mm.h>
+#include <linux/module.h>
 #include <linux/fault-inject.h>
 
 #include "v1/address_map.h"
@@ -46,6 +47,12 @@
 DECLARE_FAULT_ATTR(neuron_fail_nc_mmap);
 #endif
 
+int nq_watch_interval = 1;
+
+module_param(nq_watch_interval, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(nq_watch_interval,
+		 "Interval(in msec) at which watched notification queues are checked");
+
 #define NC_SEMAPHORE_SIZE 4
 #define NC_EVENT_SIZE 4
 
@@ -147,23 +154,6 @@ enum NQ_TYPE {
 	NQ_TYPE_MAX
 };
 
-/* Neuron notification queues can be memory mapped to read notifications from the device.
- *
- * Each device has 64(V1_NC_PER_DEVICE * MAX_NQ_ENGINE * NQ_TYPE_PER_ENGINE) notification queues.
- * Each queue is mapped to 1GB(separate vma) of space.
- */
-
-/** Max size of a notification queue mapping.
- */
-#define NC_NQ_MMAP_SIZE_PER_NQ (1 * 1024 * 1024 * 1024UL)
-#define NC_NQ_MMAP_SIZE_PER_ENGINE (NC_NQ_MMAP_SIZE_PER_NQ * NQ_TYPE_PER_ENGINE)
-#define NC_NQ_MMAP_SIZE_PER_NC (NC_NQ_MMAP_SIZE_PER_ENGINE * MAX_NQ_ENGINE)
-#define NC_NQ_MMAP_SIZE_PER_ND (NC_NQ_MMAP_SIZE_PER_NC * V1_NC_PER_DEVICE)
-
-/* offset in the devnode file */
-#define NC_NQ_MMAP_START_OFFSET (0)
-#define NC_NQ_MMAP_END_OFFSET (NC_NQ_MMAP_START_OFFSET + NC_NQ_MMAP_SIZE_PER_ND)
-
 int nc_get_nq_mmap_offset(int nc_id, int engine_index, int nq_type, u64 *offset)
 {
 	if (nc_id > V1_NC_PER_DEVICE)
@@ -201,6 +191,57 @@ int nc_get_nq_from_mmap_offset(u64 offset, int *nc_id, int *engine_index, int *n
 	return 0;
 }
 
+int nc_get_sync_mmap_offset(int nc_id, u64 *offset)
+{
+	if (nc_id >= V1_NC_PER_DEVICE)
+		return -EINVAL;
+
+	*offset = NC_SYNC_MMAP_START_OFFSET + (nc_id * NC_SYNC_MMAP_SIZE_PER_NC);
+	return 0;
+}
+
+int nc_get_sync_from_mmap_offset(u64 offset, int *nc_id)
+{
+	if (offset < NC_SYNC_MMAP_START_OFFSET)
+		return -EINVAL;
+	if (offset >= NC_SYNC_MMAP_END_OFFSET)
+		return -EINVAL;
+
+	*nc_id = (offset - NC_SYNC_MMAP_START_OFFSET) / NC_SYNC_MMAP_SIZE_PER_NC;
+	return 0;
+}
+
+int nc_sync_mmap(struct neuron_device *nd, u8 nc_id, struct vm_area_struct *vma)
+{
+	u64 size = vma->vm_end - vma->vm_start;
+	u64 aperture_offset;
+	int ret;
+
+	if (nd == NULL || nc_id >= V1_NC_PER_DEVICE)
+		return -EINVAL;
+	if (size > NC_SYNC_MMAP_SIZE_PER_NC)
+		return -EINVAL;
+	// the window is for polling only - updates must still go through the ioctls
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	aperture_offset = nc_get_axi_offset(nc_id) + MMAP_NC_EVENT_OFFSET;
+	if (aperture_offset + size > nd->npdev.bar2_size)
+		return -EINVAL;
+
+	vma->vm_flags &= ~VM_MAYWRITE; // no write access via mprotect() later either
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+	ret = io_remap_pfn_range(vma, vma->vm_start,
+				 PHYS_PFN(nd->npdev.bar2_pa + aperture_offset), size,
+				 vma->vm_page_prot);
+	if (ret != 0)
+		return ret;
+
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP | VM_DONTCOPY;
+
+	return 0;
+}
+
 int nc_nq_init(struct neuron_device *nd, u8 nc_id, u8 eng_index, u32 nq_type, u32 size)
 {
 	struct mem_chunk *mc, **mc_ptr;
@@ -222,6 +263,14 @@ int nc_nq_init(struct neuron_device *nd, u8 nc_id, u8 eng_index, u32 nq_type, u3
 		ret = mc_alloc(&nd->mpset, mc_ptr, size, MEM_LOC_HOST, 0, 0, nc_id);
 		if (ret)
 			return ret;
+		// the queue base is programmed into the hardware as one physical range,
+		// so a chunk stitched from individual pages is unusable here
+		if ((*mc_ptr)->pages) {
+			pr_err("no contiguous host memory for notification queue(%u bytes)\n",
+			       size);
+			mc_free(mc_ptr);
+			return -ENOMEM;
+		}
 	}
 	mc = *mc_ptr;
 
@@ -306,23 +355,141 @@ int nc_nq_destroy(struct neuron_device *nd, u8 nc_id, u8 eng_index, u32 nq_type)
 	// sleep 1msec so that hw can drain
 	msleep(1);
 
+	// the watch worker must not look at the queue memory once it is freed
+	spin_lock(&nd->nq_watch_lock);
+	nd->nq_watch[nc_id][nq_id].state = NC_NQ_WATCH_DISARMED;
+	spin_unlock(&nd->nq_watch_lock);
+
 	mc_free(&nd->nq_mc[nc_id][nq_id]);
 	return 0;
 }
 
-void nc_nq_destroy_all(struct neuron_device *nd)
+/**
+ * Compare every armed watch against the current queue contents. Fired watches wake the
+ * pollers and stay fired until the watch is rearmed or cancelled; the work reschedules
+ * itself while any watch is still armed.
+ */
+static void nc_nq_watch_work_fn(struct work_struct *work)
 {
-	u8 nc_id;
-	u8 eng_index;
-	u8 nq_type;
+	struct neuron_device *nd =
+		container_of(to_delayed_work(work), struct neuron_device, nq_watch_work);
+	bool fired = false, rearm = false;
+	int nc_id, nq_id;
 
+	spin_lock(&nd->nq_watch_lock);
 	for (nc_id = 0; nc_id < V1_NC_PER_DEVICE; nc_id++) {
-		for (eng_index = 0; eng_index < MAX_NQ_ENGINE; eng_index++) {
-			for (nq_type = 0; nq_type < NQ_TYPE_PER_ENGINE; nq_type++) {
-				nc_nq_destroy(nd, nc_id, eng_index, nq_type);
+		for (nq_id = 0; nq_id < MAX_NQ_SUPPORTED; nq_id++) {
+			struct nc_nq_watch *watch = &nd->nq_watch[nc_id][nq_id];
+			struct mem_chunk *mc = nd->nq_mc[nc_id][nq_id];
+			if (watch->state != NC_NQ_WATCH_ARMED)
+				continue;
+			if (mc == NULL) {
+				watch->state = NC_NQ_WATCH_DISARMED;
+				continue;
+			}
+			if (READ_ONCE(*(u32 *)(mc->va + watch->offset)) != watch->value) {
+				watch->state = NC_NQ_WATCH_FIRED;
+				fired = true;
+			} else {
+				rearm = true;
 			}
 		}
 	}
+	spin_unlock(&nd->nq_watch_lock);
+
+	if (fired)
+		wake_up_interruptible(&nd->nq_wait_queue);
+	if (rearm)
+		schedule_delayed_work(&nd->nq_watch_work, msecs_to_jiffies(nq_watch_interval));
+}
+
+void nc_nq_watch_init(struct neuron_device *nd)
+{
+	init_waitqueue_head(&nd->nq_wait_queue);
+	spin_lock_init(&nd->nq_watch_lock);
+	INIT_DELAYED_WORK(&nd->nq_watch_work, nc_nq_watch_work_fn);
+}
+
+void nc_nq_watch_stop(struct neuron_device *nd)
+{
+	int nc_id, nq_id;
+
+	spin_lock(&nd->nq_watch_lock);
+	for (nc_id = 0; nc_id < V1_NC_PER_DEVICE; nc_id++)
+		for (nq_id = 0; nq_id < MAX_NQ_SUPPORTED; nq_id++)
+			nd->nq_watch[nc_id][nq_id].state = NC_NQ_WATCH_DISARMED;
+	spin_unlock(&nd->nq_watch_lock);
+	cancel_delayed_work_sync(&nd->nq_watch_work);
+	wake_up_interruptible(&nd->nq_wait_queue);
+}
+
+int nc_nq_watch_arm(struct neuron_device *nd, u8 nc_id, u8 eng_index, u32 nq_type, u32 offset,
+		    bool arm)
+{
+	struct nc_nq_watch *watch;
+	struct mem_chunk *mc;
+	u8 nq_id;
+
+	if (nd == NULL || nc_id >= V1_NC_PER_DEVICE)
+		return -EINVAL;
+	nq_id = (nq_type * NQ_TYPE_PER_ENGINE) + eng_index;
+	if (nq_id >= MAX_NQ_SUPPORTED)
+		return -EINVAL;
+
+	spin_lock(&nd->nq_watch_lock);
+	watch = &nd->nq_watch[nc_id][nq_id];
+	if (!arm) {
+		watch->state = NC_NQ_WATCH_DISARMED;
+		spin_unlock(&nd->nq_watch_lock);
+		return 0;
+	}
+	mc = nd->nq_mc[nc_id][nq_id];
+	if (mc == NULL || (offset & 0x3) || offset + sizeof(u32) > mc->size) {
+		spin_unlock(&nd->nq_watch_lock);
+		pr_err("invalid watch on nq[%d][%d] offset %u\n", nc_id, nq_id, offset);
+		return -EINVAL;
+	}
+	watch->offset = offset;
+	watch->value = READ_ONCE(*(u32 *)(mc->va + offset));
+	watch->state = NC_NQ_WATCH_ARMED;
+	spin_unlock(&nd->nq_watch_lock);
+
+	schedule_delayed_work(&nd->nq_watch_work, msecs_to_jiffies(nq_watch_interval));
+	return 0;
+}
+
+bool nc_nq_watch_fired(struct neuron_device *nd)
+{
+	bool fired = false;
+	int nc_id, nq_id;
+
+	spin_lock(&nd->nq_watch_lock);
+	for (nc_id = 0; nc_id < V1_NC_PER_DEVICE && !fired; nc_id++)
+		for (nq_id = 0; nq_id < MAX_NQ_SUPPORTED && !fired; nq_id++)
+			fired = nd->nq_watch[nc_id][nq_id].state == NC_NQ_WATCH_FIRED;
+	spin_unlock(&nd->nq_watch_lock);
+	return fired;
+}
+
+void nc_nq_destroy_nc(struct neuron_device *nd, u8 nc_id)
+{
+	u8 eng_index;
+	u8 nq_type;
+
+	for (eng_index = 0; eng_index < MAX_NQ_ENGINE; eng_index++) {
+		for (nq_type = 0; nq_type < NQ_TYPE_PER_ENGINE; nq_type++) {
+			nc_nq_destroy(nd, nc_id, eng_index, nq_type);
+		}
+	}
+}
+
+void nc_nq_destroy_all(struct neuron_device *nd)
+{
+	u8 nc_id;
+
+	for (nc_id = 0; nc_id < V1_NC_PER_DEVICE; nc_id++) {
+		nc_nq_destroy_nc(nd, nc_id);
+	}
 }
 
 int nc_nq_mmap(struct neuron_device *nd, u8 nc_id, u8 eng_index, u32 nq_type,
@@ -341,6 +508,9 @@ int nc_nq_mmap(struct neuron_device *nd, u8 nc_id, u8 eng_index, u32 nq_type,
 	mc = nd->nq_mc[nc_id][nq_id];
 	if (mc == NULL)
 		return -EINVAL;
+	// only physically contiguous chunks can be mapped as one range
+	if (mc->pages)
+		return -EINVAL;
 
 #ifdef CONFIG_FAULT_INJECTION
 	if (should_fail(&neuron_fail_nc_mmap, 1))
@@ -6,6 +6,8 @@
 #ifndef NEURON_NOTIFICATION_H
 #define NEURON_NOTIFICATION_H
 
+#include "v1/address_map.h"
+
 /**
  * nc_semaphore_read() - Read current semaphore value
  *
@@ -84,6 +86,46 @@ int nc_event_set(struct neuron_device *nd, u8 nc_id, u16 event_index, u32 value)
 
 #define MAX_NQ_SUPPORTED (MAX_NQ_TYPE * MAX_NQ_ENGINE)
 
+/* State of one notification queue watch - armed by an ioctl, checked by a low rate
+ * kernel worker so the runtime can poll() instead of spinning on the mmap'd ring.
+ */
+enum nc_nq_watch_state {
+	NC_NQ_WATCH_DISARMED = 0, // nobody is watching this queue
+	NC_NQ_WATCH_ARMED, // worker compares the watched word every interval
+	NC_NQ_WATCH_FIRED, // the watched word changed; poll() reports readable
+};
+
+struct nc_nq_watch {
+	enum nc_nq_watch_state state;
+	u32 offset; // offset of the watched word in the queue
+	u32 value; // value of the word when the watch was armed
+};
+
+/* Neuron notification queues can be memory mapped to read notifications from the device.
+ *
+ * Each device has 64(V1_NC_PER_DEVICE * MAX_NQ_ENGINE * NQ_TYPE_PER_ENGINE) notification queues.
+ * Each queue is mapped to 1GB(separate vma) of space.
+ */
+
+/** Max size of a notification queue mapping.
+ */
+#define NC_NQ_MMAP_SIZE_PER_NQ (1 * 1024 * 1024 * 1024UL)
+#define NC_NQ_MMAP_SIZE_PER_ENGINE (NC_NQ_MMAP_SIZE_PER_NQ * NQ_TYPE_PER_ENGINE)
+#define NC_NQ_MMAP_SIZE_PER_NC (NC_NQ_MMAP_SIZE_PER_ENGINE * MAX_NQ_ENGINE)
+#define NC_NQ_MMAP_SIZE_PER_ND (NC_NQ_MMAP_SIZE_PER_NC * V1_NC_PER_DEVICE)
+
+/* offset in the devnode file */
+#define NC_NQ_MMAP_START_OFFSET (0)
+#define NC_NQ_MMAP_END_OFFSET (NC_NQ_MMAP_START_OFFSET + NC_NQ_MMAP_SIZE_PER_ND)
+
+/* Each core's event/semaphore registers can be mapped read-only so applications
+ * poll synchronization state with a load instead of an ioctl.
+ */
+#define NC_SYNC_MMAP_SIZE_PER_NC (64 * 1024UL)
+#define NC_SYNC_MMAP_START_OFFSET NC_NQ_MMAP_END_OFFSET
+#define NC_SYNC_MMAP_END_OFFSET \
+	(NC_SYNC_MMAP_START_OFFSET + (NC_SYNC_MMAP_SIZE_PER_NC * V1_NC_PER_DEVICE))
+
 /**
  * nc_get_nq_mmap_offset() - Get notification queue's mmap offset for given neuron core.
  *
@@ -141,6 +183,58 @@ int nc_nq_destroy(struct neuron_device *nd, u8 nc_id, u8 eng_index, u32 nq_type)
  */
 void nc_nq_destroy_all(struct neuron_device *nd);
 
+/**
+ * nc_nq_destroy_nc() - Disable notification in one neuron core
+ *
+ * @nd: neuron device
+ * @nc_id: neuron core index
+ *
+ */
+void nc_nq_destroy_nc(struct neuron_device *nd, u8 nc_id);
+
+/**
+ * nc_nq_watch_init() - Initialize the notification queue watch state of a device.
+ *
+ * @nd: neuron device
+ */
+void nc_nq_watch_init(struct neuron_device *nd);
+
+/**
+ * nc_nq_watch_stop() - Disarm all watches and stop the watch worker.
+ *
+ * @nd: neuron device
+ */
+void nc_nq_watch_stop(struct neuron_device *nd);
+
+/**
+ * nc_nq_watch_arm() - Arm or cancel a watch on a notification queue.
+ *
+ * When armed, a kernel worker compares the 32bit word at the given queue offset with
+ * its value at arm time; once it changes poll() on the device reports the fd readable.
+ * The runtime passes the offset of the next unread entry, so the next notification the
+ * hardware writes triggers the wake up.
+ *
+ * @nd: neuron device
+ * @nc_id: core index in the device
+ * @eng_index: notification engine index in the core
+ * @nq_type: type of the notification queue
+ * @offset: offset of the word to watch in the queue
+ * @arm: true to arm the watch, false to cancel it
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int nc_nq_watch_arm(struct neuron_device *nd, u8 nc_id, u8 eng_index, u32 nq_type, u32 offset,
+		    bool arm);
+
+/**
+ * nc_nq_watch_fired() - Check whether any armed watch on the device has fired.
+ *
+ * @nd: neuron device
+ *
+ * Return: true if at least one watched queue has new entries.
+ */
+bool nc_nq_watch_fired(struct neuron_device *nd);
+
 /**
  * nc_nq_mmap() - mmap the notification queue into process address space.
  *
@@ -155,4 +249,35 @@ void nc_nq_destroy_all(struct neuron_device *nd);
 int nc_nq_mmap(struct neuron_device *nd, u8 nc_id, u8 eng_index, u32 nq_type,
 	       struct vm_area_struct *vma);
 
+/**
+ * nc_get_sync_mmap_offset() - Get the sync window's mmap offset for given neuron core.
+ *
+ * @nc_id: neuron core index.
+ * @offset: mmap offset for the core's event/semaphore window is stored here.
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int nc_get_sync_mmap_offset(int nc_id, u64 *offset);
+
+/**
+ * nc_get_sync_from_mmap_offset() - Get the neuron core index from given sync mmap offset.
+ *
+ * @offset: mmap offset.
+ * @nc_id: neuron core index which is mapped by this mmap offset is updated here.
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int nc_get_sync_from_mmap_offset(u64 offset, int *nc_id);
+
+/**
+ * nc_sync_mmap() - mmap a core's event/semaphore registers read-only.
+ *
+ * @nd: neuron device
+ * @nc_id: core index in the device
+ * @vma: mmap area.
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int nc_sync_mmap(struct neuron_device *nd, u8 nc_id, struct vm_area_struct *vma);
+
 #endif
@@ -6,12 +6,18 @@
 #ifndef NEURON_DEVICE_H
 #define NEURON_DEVICE_H
 
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/idr.h>
+
 #include "neuron_mempool.h"
 #include "neuron_ring.h"
 #include "neuron_core.h"
 
 #include "neuron_ioctl.h"
 
+struct dentry;
+
 // Maximum neuron devices supported on a system.
 #define MAX_NEURON_DEVICE_COUNT 16
 
@@ -36,14 +42,31 @@ struct neuron_device {
 	u8 revision;
 	pid_t current_pid;
 	int current_pid_open_count;
+	// owner of each neuron core when the device is shared core by core(0 = unclaimed).
+	// unused(all zero) when a process claims the whole device via DEVICE_INIT.
+	pid_t nc_pid[V1_NC_PER_DEVICE];
 	u8 architecture;
 
+	struct work_struct init_work; // device bring-up, runs on the module's init workqueue
+	int init_ret; // result of the asynchronous bring-up
+
 	void *cdev; // chardev created for this devices
 
+	struct dentry *dbgfs_dir; // this device's directory under the module's debugfs root
+
+	struct workqueue_struct *async_copy_wq; // executes asynchronous DMA copies
+	struct idr async_copy_idr; // in flight and not yet reaped async copies, by transfer id
+	spinlock_t async_copy_lock; // protects async_copy_idr and transfer status updates
+
+	struct idr dma_prog_idr; // registered DMA descriptor programs, by program handle
+	struct mutex dma_prog_lock; // protects dma_prog_idr
+
 	struct neuron_pci_device npdev;
 
 	struct ndma_eng ndma_engine[NUM_DMA_ENG_PER_DEVICE];
 
+	int num_irqs; // number of MSI-X vectors allocated for the device
+
 	void *fw_io_ctx;
 
 	struct mempool_set mpset;
@@ -51,8 +74,14 @@ struct neuron_device {
 	// memory chunk allocated for notification queue in each neuron core.
 	struct mem_chunk *nq_mc[V1_NC_PER_DEVICE][MAX_NQ_SUPPORTED];
 
+	wait_queue_head_t nq_wait_queue; // woken when a watched notification queue advances
+	spinlock_t nq_watch_lock; // protects the watch table
+	struct nc_nq_watch nq_watch[V1_NC_PER_DEVICE][MAX_NQ_SUPPORTED];
+	struct delayed_work nq_watch_work; // low rate scanner for the armed watches
+
 	int connected_device_count; // number of devices connected to this device
 	u32 connected_devices[MAX_NEURON_DEVICE_COUNT]; // device ids of the connected devices
+	u64 connected_device_bases[MAX_NEURON_DEVICE_COUNT]; // PCIe window base to reach each connected device
 };
 
 /**
@@ -7,6 +7,11 @@
 
 #include <linux/string.h>
 #include <linux/delay.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/sched.h>
 #include <linux/fault-inject.h>
 
 #include "udma/udma.h"
@@ -16,6 +21,19 @@
 #include "neuron_device.h"
 #include "neuron_dma.h"
 #include "neuron_mempool.h"
+#include "neuron_stats.h"
+
+int ndma_stripe_threshold = 1024 * 1024;
+
+module_param(ndma_stripe_threshold, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(ndma_stripe_threshold,
+		 "Minimum transfer size to stripe across all H2T DMA engines(0 disables striping)");
+
+int ndma_pio_threshold = 256;
+
+module_param(ndma_pio_threshold, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(ndma_pio_threshold,
+		 "Maximum transfer size copied with programmed I/O instead of DMA(0 disables the fast path)");
 
 #ifdef CONFIG_FAULT_INJECTION
 DECLARE_FAULT_ATTR(neuron_fail_dma_wait);
@@ -36,52 +54,134 @@ void ndma_ack_completed_desc(struct ndma_eng *eng, struct ndma_ring *ring, u32 c
 #define DMA_COMPLETION_MARKER_SIZE sizeof(u32)
 #define DMA_COMPLETION_MARKER 0xabcdef01
 
+irqreturn_t ndma_h2t_irq_handler(int irq, void *data)
+{
+	struct ndma_eng *eng = (struct ndma_eng *)data;
+
+	udma_iofic_completion_ack(&eng->udma, MAX_DMA_RINGS - 1);
+	complete(&eng->h2t_done);
+	return IRQ_HANDLED;
+}
+
+/* Only the first H2T ring(queue MAX_DMA_RINGS - 1) has its completion wired to the
+ * engine's MSI-X vector; the other rings poll.
+ */
+static bool ndma_h2t_ring_has_irq(struct ndma_eng *eng, struct ndma_ring *ring)
+{
+	return eng->irq >= 0 && ring->qid == MAX_DMA_RINGS - 1;
+}
+
 /**
- * Wait for completion by start transfer of a DMA between two host memory locations and polling
- * on the host memory for the data to be written.
+ * Pick an H2T ring for a transfer. Rings are tried round robin with trylock so
+ * concurrent callers land on different rings; if every ring is busy the caller
+ * queues on its round robin choice. The ring is locked on return - release it
+ * with ndma_h2t_ring_release().
  */
-int ndma_memcpy_wait_for_completion(struct ndma_eng *eng, struct ndma_ring *ring, u32 count)
+static struct ndma_ring *ndma_h2t_ring_acquire(struct ndma_eng *eng, int *rid_out)
+{
+	u32 start = (u32)atomic_inc_return(&eng->h2t_ring_rr);
+	u32 i, rid;
+
+	for (i = 0; i < eng->h2t_ring_count; i++) {
+		rid = (start + i) % eng->h2t_ring_count;
+		if (mutex_trylock(&eng->h2t_ring_lock[rid]))
+			goto locked;
+	}
+	rid = start % eng->h2t_ring_count;
+	mutex_lock(&eng->h2t_ring_lock[rid]);
+locked:
+	*rid_out = rid;
+	return &eng->queues[MAX_DMA_RINGS - 1 - rid].ring_info;
+}
+
+static void ndma_h2t_ring_release(struct ndma_eng *eng, int rid)
+{
+	mutex_unlock(&eng->h2t_ring_lock[rid]);
+}
+
+/* An in-flight completion marker - a host to host descriptor appended after a batch of
+ * data descriptors. The batch is known to be complete once the marker value lands in
+ * the destination buffer.
+ */
+struct ndma_h2t_marker {
+	struct udma_ring_ptr rxc; // 2 * DMA_COMPLETION_MARKER_SIZE of host memory(src and dst)
+	u32 count; // number of descriptors acked by this marker(data + marker itself)
+};
+
+/**
+ * Queue a completion marker descriptor behind count data descriptors and start the copy.
+ * The caller waits for it later with ndma_h2t_marker_wait() - more descriptors can be
+ * queued on the ring in between.
+ *
+ * @reinit: true if no other marker is outstanding on this engine - resets the irq
+ *	    completion object so a stale signal can't satisfy this marker's wait.
+ */
+static int ndma_h2t_marker_post(struct ndma_eng *eng, struct ndma_ring *ring, u32 count,
+				bool reinit, struct ndma_h2t_marker *marker)
 {
-	struct udma_ring_ptr rxc;
-	int ret = 0;
 	volatile u32 *dst;
 	volatile u32 *src;
-	u64 i;
-
-	// One descriptor takes ~4 usec to transfer (64K at 16G/sec) -  wait 100x longer
-	u64 wait = 4 * count * 100;
-	unsigned long one_loop_sleep = 1; // poll every 10 usecs
-	u64 loop = wait / one_loop_sleep + 1;
+	int ret;
 
-	rxc.ptr = kmalloc(DMA_COMPLETION_MARKER_SIZE * 2, GFP_ATOMIC);
-	if (!rxc.ptr) {
+	marker->rxc.ptr = kmalloc(DMA_COMPLETION_MARKER_SIZE * 2, GFP_ATOMIC);
+	if (!marker->rxc.ptr) {
 		pr_err("can't allocate memory for completion\n");
 		return -1;
 	}
-	dst = (volatile u32 *)(rxc.ptr + DMA_COMPLETION_MARKER_SIZE);
-	src = (volatile u32 *)rxc.ptr;
+	dst = (volatile u32 *)(marker->rxc.ptr + DMA_COMPLETION_MARKER_SIZE);
+	src = (volatile u32 *)marker->rxc.ptr;
 
 	// set the src value to the marker
 	WRITE_ONCE(*src, DMA_COMPLETION_MARKER);
 	WRITE_ONCE(*dst, 0);
 
-	rxc.addr = virt_to_phys(rxc.ptr) | PCIEX8_0_BASE;
-	ret = udma_m2m_copy_prepare_one(&eng->udma, ring->qid, rxc.addr,
-					rxc.addr + DMA_COMPLETION_MARKER_SIZE,
-					DMA_COMPLETION_MARKER_SIZE, false, false);
+	if (reinit && ndma_h2t_ring_has_irq(eng, ring))
+		reinit_completion(&eng->h2t_done);
+
+	marker->rxc.addr = virt_to_phys(marker->rxc.ptr) | PCIEX8_0_BASE;
+	ret = udma_m2m_copy_prepare_one(&eng->udma, ring->qid, marker->rxc.addr,
+					marker->rxc.addr + DMA_COMPLETION_MARKER_SIZE,
+					DMA_COMPLETION_MARKER_SIZE, false,
+					ndma_h2t_ring_has_irq(eng, ring));
 	if (ret) {
 		pr_err("failed to prepare DMA descriptor for %s q%d\n", eng->udma.name, ring->qid);
 		ret = -1;
 		goto error;
 	}
 
-	count++; // for host to host(completion) descriptor.
+	marker->count = count + 1; // +1 for host to host(completion) descriptor.
 
 	ret = udma_m2m_copy_start(&eng->udma, ring->qid, 1, 1);
 	if (ret) {
 		pr_err("failed to start DMA copy for %s q%d\n", eng->udma.name, ring->qid);
 		goto error;
 	}
+	return 0;
+
+error:
+	kfree(marker->rxc.ptr);
+	marker->rxc.ptr = NULL;
+	return ret;
+}
+
+/**
+ * Wait for a posted marker to land in host memory and ack the descriptors it covers.
+ *
+ * If an MSI-X vector is wired to the engine the wait sleeps on a completion object instead of
+ * burning the CPU; the poll loop is kept as fallback since interrupt delivery is best effort.
+ */
+static int ndma_h2t_marker_wait(struct ndma_eng *eng, struct ndma_ring *ring,
+				struct ndma_h2t_marker *marker)
+{
+	volatile u32 *dst = (volatile u32 *)(marker->rxc.ptr + DMA_COMPLETION_MARKER_SIZE);
+	ktime_t wait_start = ktime_get();
+	int ret = 0;
+	u64 i;
+
+	// One descriptor takes ~4 usec to transfer (64K at 16G/sec) -  wait 100x longer
+	u64 wait = 4 * marker->count * 100;
+	unsigned long one_loop_sleep = 1; // poll every 10 usecs
+	u64 loop = wait / one_loop_sleep + 1;
 
 #ifdef CONFIG_FAULT_INJECTION
 	if (should_fail(&neuron_fail_dma_wait, 1)) {
@@ -89,18 +189,19 @@ int ndma_memcpy_wait_for_completion(struct ndma_eng *eng, struct ndma_ring *ring
 		goto error;
 	}
 #endif
+	// sleep till the interrupt handler signals; poll loop below handles lost interrupts
+	if (ndma_h2t_ring_has_irq(eng, ring))
+		wait_for_completion_timeout(&eng->h2t_done, usecs_to_jiffies(wait) + 1);
+
 	for (i = 0; i <= loop; i++) {
 		u32 dst_val = READ_ONCE(*dst);
 		// this descriptor is executed, meaning all other have completed
 		if (dst_val == DMA_COMPLETION_MARKER) {
-			// reset in case we are going to use this ring again
-			WRITE_ONCE(*dst, 0);
-			WRITE_ONCE(*src, DMA_COMPLETION_MARKER);
 			// while we don't have completion ring, udma uses completion counter
 			// for keeping track of which descriptors are free and can be allocated
 			// Call ack in order to advance the counter, otherwise we eventually
 			// run out of the descriptors to allocate on this ring
-			ndma_ack_completed_desc(eng, ring, count);
+			ndma_ack_completed_desc(eng, ring, marker->count);
 			break;
 		}
 		udelay(one_loop_sleep);
@@ -112,12 +213,28 @@ int ndma_memcpy_wait_for_completion(struct ndma_eng *eng, struct ndma_ring *ring
 	}
 
 error:
-	if (rxc.ptr)
-		kfree(rxc.ptr);
+	ndma_stats_wait(eng, ktime_us_delta(ktime_get(), wait_start));
+	kfree(marker->rxc.ptr);
+	marker->rxc.ptr = NULL;
 
 	return ret;
 }
 
+/**
+ * Wait for completion by start transfer of a DMA between two host memory locations and polling
+ * on the host memory for the data to be written.
+ */
+int ndma_memcpy_wait_for_completion(struct ndma_eng *eng, struct ndma_ring *ring, u32 count)
+{
+	struct ndma_h2t_marker marker;
+	int ret;
+
+	ret = ndma_h2t_marker_post(eng, ring, count, true, &marker);
+	if (ret)
+		return ret;
+	return ndma_h2t_marker_wait(eng, ring, &marker);
+}
+
 static int ndma_memcpy64k(struct ndma_eng *eng, struct ndma_ring *ring, dma_addr_t src,
 			  dma_addr_t dst, u32 size, bool set_dmb)
 {
@@ -133,84 +250,357 @@ static int ndma_memcpy64k(struct ndma_eng *eng, struct ndma_ring *ring, dma_addr
 		pr_err("failed to start DMA copy for %s q%d\n", eng->udma.name, ring->qid);
 		return ret;
 	}
+	ndma_stats_xfer(eng, size);
 
 	return ret;
 }
 
-int ndma_memcpy(struct neuron_device *nd, u32 nc_id, dma_addr_t src, dma_addr_t dst, u32 size)
+static int ndma_memcpy_engine(struct neuron_device *nd, u32 nc_id, dma_addr_t src, dma_addr_t dst,
+			      u32 size)
 {
-	u32 chunk_size, remaining;
-	int pending_transfers = 0;
-	// max number of usable descriptors - we never allocate the last 16 (max_num_... ) and need to
-	// keep one free for checking completion
-	const u32 sync_threshold = DMA_H2T_DESC_COUNT - UDMA_MAX_NUM_CDESC_PER_CACHE_LINE - 1;
+	u32 remaining;
+	u32 batch_bytes = 0;
+	u32 pending_transfers = 0;
+	// the ring is split in two batches so one half can be refilled while the other is in
+	// flight - we never allocate the last 16 (max_num_... ) and each batch needs one
+	// descriptor for its completion marker
+	u32 batch_size;
+	struct ndma_h2t_marker markers[2];
+	bool marker_valid[2] = { false, false };
+	int mi = 0; // marker slot for the next batch
 	u32 offset;
-	int ret = 0;
+	int i, ret = 0, ret2;
 	struct ndma_eng *eng;
-	struct ndma_queue *queue;
 	struct ndma_ring *ring;
+	int rid;
 	int eng_id = DMA_ENG_IDX_H2T + (nc_id * V1_DMA_ENG_PER_NC);
 
 	eng = &(nd->ndma_engine[eng_id]);
-	queue = &eng->queues[MAX_DMA_RINGS - 1];
-	ring = &queue->ring_info;
 
-	chunk_size = size < MAX_DMA_DESC_SIZE ? size : MAX_DMA_DESC_SIZE;
 	remaining = size;
-	mutex_lock(&eng->h2t_ring_lock);
+	ring = ndma_h2t_ring_acquire(eng, &rid);
+	batch_size = (ring->ndesc - UDMA_MAX_NUM_CDESC_PER_CACHE_LINE) / 2 - 1;
+
+	for (offset = 0; remaining; offset += batch_bytes, remaining -= batch_bytes) {
+		bool batch_end;
+		u32 needed = DIV_ROUND_UP(remaining, MAX_DMA_DESC_SIZE);
+		u32 room = batch_size - pending_transfers;
+		u32 ndesc = needed < room ? needed : room;
+		u32 prepared = 0;
+
+		// bytes covered by this run of descriptors
+		if (ndesc == needed)
+			batch_bytes = remaining;
+		else
+			batch_bytes = ndesc * MAX_DMA_DESC_SIZE;
+
+		// descriptors for the whole run are written in one pass, the doorbell is
+		// rung once for all of them
+		batch_end = (pending_transfers + ndesc == batch_size) || ndesc == needed;
+		ret = udma_m2m_copy_prepare_sg(&eng->udma, ring->qid, src + offset, dst + offset,
+					       batch_bytes, ndesc, batch_end, &prepared);
+		if (ret) {
+			pr_err("failed to prepare DMA descriptors for %s q%d\n", eng->udma.name,
+			       ring->qid);
+			goto drain;
+		}
+		ret = udma_m2m_copy_start(&eng->udma, ring->qid, prepared, prepared);
+		if (ret) {
+			pr_err("failed to start DMA copy for %s q%d\n", eng->udma.name, ring->qid);
+			goto drain;
+		}
+		ndma_stats_xfer(eng, batch_bytes);
+		pending_transfers += prepared;
+		trace_dma_memcpy(nd, nc_id, src + offset, dst + offset, batch_bytes,
+				 pending_transfers);
+		if (batch_end) {
+			// reclaim the oldest batch's slot first, so at most two batches are
+			// in flight and the ring can't overflow; the other batch keeps the
+			// engine busy during this wait
+			if (marker_valid[mi]) {
+				ret = ndma_h2t_marker_wait(eng, ring, &markers[mi]);
+				marker_valid[mi] = false;
+				if (ret)
+					goto drain;
+			}
+			ret = ndma_h2t_marker_post(eng, ring, pending_transfers,
+						   !marker_valid[mi ^ 1], &markers[mi]);
+			if (ret)
+				goto drain;
+			marker_valid[mi] = true;
+			mi ^= 1;
+			pending_transfers = 0;
+		}
+	}
+
+drain:
+	// wait for the in flight batches, oldest first
+	for (i = 0; i < 2; i++, mi ^= 1) {
+		if (!marker_valid[mi])
+			continue;
+		ret2 = ndma_h2t_marker_wait(eng, ring, &markers[mi]);
+		marker_valid[mi] = false;
+		if (ret2 && !ret)
+			ret = ret2;
+	}
+	ndma_h2t_ring_release(eng, rid);
+	return ret;
+}
+
+/**
+ * Stripe a large copy over the H2T engine of every neuron core so it runs at the
+ * aggregate bandwidth of the device instead of a single queue. Chunks are issued
+ * round-robin without waiting in between - the engines execute concurrently - and
+ * completion is checked per engine only when its ring fills up and once at the end.
+ */
+static int ndma_memcpy_striped(struct neuron_device *nd, dma_addr_t src, dma_addr_t dst, u32 size)
+{
+	u32 sync_threshold = 0;
+	struct ndma_eng *eng[V1_NC_PER_DEVICE];
+	struct ndma_ring *ring[V1_NC_PER_DEVICE];
+	int rid[V1_NC_PER_DEVICE];
+	u32 pending[V1_NC_PER_DEVICE] = { 0 };
+	u32 last_chunk[V1_NC_PER_DEVICE];
+	u32 num_chunks = DIV_ROUND_UP(size, MAX_DMA_DESC_SIZE);
+	u32 chunk_size, remaining, offset, chunk;
+	int i, ret = 0;
+
+	for (i = 0; i < V1_NC_PER_DEVICE; i++) {
+		int eng_id = DMA_ENG_IDX_H2T + (i * V1_DMA_ENG_PER_NC);
+		eng[i] = &(nd->ndma_engine[eng_id]);
+		// index of the final chunk this engine will carry - it needs the barrier
+		// set so the completion marker lands only after the data
+		if (num_chunks > i)
+			last_chunk[i] = i + ((num_chunks - 1 - i) / V1_NC_PER_DEVICE) *
+						    V1_NC_PER_DEVICE;
+		else
+			last_chunk[i] = num_chunks; // engine unused
+		ring[i] = ndma_h2t_ring_acquire(eng[i], &rid[i]);
+		// every H2T ring has the same depth, so one threshold works for all
+		if (sync_threshold == 0)
+			sync_threshold = ring[i]->ndesc - UDMA_MAX_NUM_CDESC_PER_CACHE_LINE - 1;
+	}
+
+	chunk_size = MAX_DMA_DESC_SIZE;
+	remaining = size;
+	for (chunk = 0, offset = 0; remaining; chunk++, offset += chunk_size, remaining -= chunk_size) {
+		bool set_dmb;
 
-	for (offset = 0; remaining; offset += chunk_size, remaining -= chunk_size) {
 		if (remaining < MAX_DMA_DESC_SIZE)
 			chunk_size = remaining;
-
-		dma_addr_t src_offset, dst_offset;
-		src_offset = src + offset;
-		dst_offset = dst + offset;
-		if (++pending_transfers == sync_threshold || chunk_size == remaining) {
-			// no more room, transfer what's been queued so far OR last chunk
-			ret = ndma_memcpy64k(eng, ring, src_offset, dst_offset, chunk_size, true);
-			if (ret)
-				goto fail;
-			ret = ndma_memcpy_wait_for_completion(eng, ring, pending_transfers);
-			if (ret)
-				goto fail;
-			pending_transfers = 0;
-		} else {
-			ret = ndma_memcpy64k(eng, ring, src_offset, dst_offset, chunk_size, false);
+		i = chunk % V1_NC_PER_DEVICE;
+		set_dmb = (pending[i] + 1 == sync_threshold) || chunk == last_chunk[i];
+		ret = ndma_memcpy64k(eng[i], ring[i], src + offset, dst + offset, chunk_size,
+				     set_dmb);
+		if (ret)
+			goto fail;
+		trace_dma_memcpy(nd, i, src + offset, dst + offset, chunk_size, pending[i]);
+		if (++pending[i] == sync_threshold) {
+			// ring is full - wait for this engine while the others keep going
+			ret = ndma_memcpy_wait_for_completion(eng[i], ring[i], pending[i]);
 			if (ret)
 				goto fail;
+			pending[i] = 0;
 		}
-		trace_dma_memcpy(nd, nc_id, src_offset, dst_offset, chunk_size, pending_transfers);
+	}
+
+	// wait for engines which still have descriptors in flight
+	for (i = 0; i < V1_NC_PER_DEVICE; i++) {
+		if (pending[i] == 0)
+			continue;
+		ret = ndma_memcpy_wait_for_completion(eng[i], ring[i], pending[i]);
+		if (ret)
+			break;
 	}
 
 fail:
-	mutex_unlock(&eng->h2t_ring_lock);
+	for (i = V1_NC_PER_DEVICE - 1; i >= 0; i--)
+		ndma_h2t_ring_release(eng[i], rid[i]);
 	return ret;
 }
 
+int ndma_memcpy(struct neuron_device *nd, u32 nc_id, dma_addr_t src, dma_addr_t dst, u32 size)
+{
+	// large copies are striped over every H2T engine, small ones stay on the core's own
+	// engine to avoid the extra locking and completion markers
+	if (ndma_stripe_threshold > 0 && size > ndma_stripe_threshold)
+		return ndma_memcpy_striped(nd, src, dst, size);
+	return ndma_memcpy_engine(nd, nc_id, src, dst, size);
+}
+
+/**
+ * Resolve an offset inside a mem chunk to a DMA address and the number of contiguous
+ * bytes available from there. Registered user memory is backed by multiple physically
+ * contiguous runs; driver owned chunks are a single run.
+ */
+static int ndma_mc_resolve(struct mem_chunk *mc, u64 offset, dma_addr_t *pa, u64 *contig)
+{
+	if (mc->nr_runs) {
+		u32 i;
+		for (i = 0; i < mc->nr_runs; i++) {
+			struct mem_chunk *run = mc->runs[i];
+			if (offset >= run->run_offset && offset < run->run_offset + run->size) {
+				*pa = (run->pa + (offset - run->run_offset)) | PCIEX8_0_BASE;
+				*contig = run->size - (offset - run->run_offset);
+				return 0;
+			}
+		}
+		return -EINVAL;
+	}
+	if (mc->mem_location == MEM_LOC_HOST)
+		*pa = (virt_to_phys(mc->va) | PCIEX8_0_BASE) + offset;
+	else
+		*pa = mc->pa + offset;
+	*contig = mc->size - offset;
+	return 0;
+}
+
+/**
+ * Map an offset in a mem chunk to something the CPU can copy to/from directly -
+ * the kernel mapping for simple host chunks, the BAR2 aperture for device
+ * addresses inside the NC window. Device DRAM sits outside the aperture and is
+ * not reachable this way.
+ *
+ * Exactly one of *va/*io is set on success.
+ */
+static bool ndma_mc_pio_addr(struct neuron_device *nd, struct mem_chunk *mc, u64 offset, u32 size,
+			     void **va, void __iomem **io)
+{
+	*va = NULL;
+	*io = NULL;
+	if (mc->mem_location == MEM_LOC_HOST) {
+		// registered user memory has no kernel mapping, leave it to the DMA path
+		if (mc->va == NULL || mc->nr_runs)
+			return false;
+		*va = mc->va + offset;
+		return true;
+	}
+	if (mc->pa + offset >= P_0_NC_0_BASE &&
+	    mc->pa + offset + size <= P_0_NC_0_BASE + nd->npdev.bar2_size) {
+		*io = nd->npdev.bar2 + (mc->pa + offset - P_0_NC_0_BASE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Small transfer fast path - copy with programmed I/O when both ends are
+ * directly addressable, skipping the H2T ring, its lock and the completion
+ * marker entirely. Returns false when either end needs the DMA engine.
+ */
+static bool ndma_memcpy_pio(struct neuron_device *nd, struct mem_chunk *src_mc,
+			    struct mem_chunk *dst_mc, u64 src_off, u64 dst_off, u32 size)
+{
+	void *src_va, *dst_va;
+	void __iomem *src_io, *dst_io;
+
+	if (!ndma_mc_pio_addr(nd, src_mc, src_off, size, &src_va, &src_io))
+		return false;
+	if (!ndma_mc_pio_addr(nd, dst_mc, dst_off, size, &dst_va, &dst_io))
+		return false;
+	if (src_io && dst_io) // no CPU assisted device to device copies
+		return false;
+
+	if (dst_io) {
+		memcpy_toio(dst_io, src_va, size);
+		readl(dst_io); // flush the posted writes so the transfer is complete on return
+	} else if (src_io) {
+		memcpy_fromio(dst_va, src_io, size);
+	} else {
+		memcpy(dst_va, src_va, size);
+	}
+	return true;
+}
+
 int ndma_memcpy_mc(struct neuron_device *nd, struct mem_chunk *src_mc, struct mem_chunk *dst_mc,
 		   u32 src_offset, u32 dst_offset, u32 size)
 {
-	dma_addr_t src_pa, dst_pa;
+	u64 remaining = size;
+	u64 src_off = src_offset, dst_off = dst_offset;
 	u32 nc_id = 0; //default use NC 0
+	int ret;
 
-	if (src_mc->mem_location == MEM_LOC_HOST) {
-		src_pa = virt_to_phys(src_mc->va) | PCIEX8_0_BASE;
-	} else {
-		src_pa = src_mc->pa;
+	if (src_mc->mem_location == MEM_LOC_DEVICE)
 		nc_id = src_mc->nc_id;
+	if (dst_mc->mem_location == MEM_LOC_DEVICE)
+		nc_id = dst_mc->nc_id;
+
+	// small control transfers skip the descriptor/doorbell/completion round trip
+	if (ndma_pio_threshold > 0 && size <= ndma_pio_threshold &&
+	    ndma_memcpy_pio(nd, src_mc, dst_mc, src_offset, dst_offset, size))
+		return 0;
+
+	// driver owned chunks are contiguous, so this loops once; registered user memory
+	// is copied run by run
+	while (remaining) {
+		dma_addr_t src_pa, dst_pa;
+		u64 src_contig, dst_contig, seg;
+
+		ret = ndma_mc_resolve(src_mc, src_off, &src_pa, &src_contig);
+		if (ret)
+			return ret;
+		ret = ndma_mc_resolve(dst_mc, dst_off, &dst_pa, &dst_contig);
+		if (ret)
+			return ret;
+		seg = remaining;
+		if (seg > src_contig)
+			seg = src_contig;
+		if (seg > dst_contig)
+			seg = dst_contig;
+		ret = ndma_memcpy(nd, nc_id, src_pa, dst_pa, seg);
+		if (ret)
+			return ret;
+		src_off += seg;
+		dst_off += seg;
+		remaining -= seg;
 	}
-	src_pa += src_offset;
+	return 0;
+}
 
-	if (dst_mc->mem_location == MEM_LOC_HOST) {
-		dst_pa = virt_to_phys(dst_mc->va) | PCIEX8_0_BASE;
-	} else {
-		dst_pa = dst_mc->pa;
-		nc_id = dst_mc->nc_id;
+int ndma_memcpy_p2p(struct neuron_device *nd, struct mem_chunk *src_mc, u32 src_offset,
+		    u32 peer_device_id, dma_addr_t dst, u32 size)
+{
+	u64 peer_base = 0;
+	u64 remaining = size;
+	u64 src_off = src_offset, dst_off = 0;
+	u32 nc_id = 0;
+	int i, ret;
+
+	for (i = 0; i < nd->connected_device_count; i++) {
+		if (nd->connected_devices[i] == peer_device_id) {
+			peer_base = nd->connected_device_bases[i];
+			break;
+		}
+	}
+	if (peer_base == 0) {
+		pr_err("device %u is not connected to device %d\n", peer_device_id,
+		       nd->device_index);
+		return -ENODEV;
 	}
-	dst_pa += dst_offset;
 
-	return ndma_memcpy(nd, nc_id, src_pa, dst_pa, size);
+	if (src_mc->mem_location == MEM_LOC_DEVICE)
+		nc_id = src_mc->nc_id;
+
+	// the peer's address space is visible through its east/west PCIe window, so the
+	// local engine writes the peer's DRAM directly - one pass over PCIe, no host staging
+	while (remaining) {
+		dma_addr_t src_pa;
+		u64 src_contig, seg;
+
+		ret = ndma_mc_resolve(src_mc, src_off, &src_pa, &src_contig);
+		if (ret)
+			return ret;
+		seg = remaining;
+		if (seg > src_contig)
+			seg = src_contig;
+		ret = ndma_memcpy(nd, nc_id, src_pa, peer_base | (dst + dst_off), seg);
+		if (ret)
+			return ret;
+		src_off += seg;
+		dst_off += seg;
+		remaining -= seg;
+	}
+	return 0;
 }
 
 int ndma_memcpy_buf_to_mc(struct neuron_device *nd, void *buffer, u32 src_offset,
@@ -224,6 +614,9 @@ int ndma_memcpy_buf_to_mc(struct neuron_device *nd, void *buffer, u32 src_offset
 	src_pa += src_offset;
 
 	if (dst_mc->mem_location == MEM_LOC_HOST) {
+		// a page backed chunk has no contiguous physical range behind its va
+		if (dst_mc->pages)
+			return -EINVAL;
 		dst_pa = virt_to_phys(dst_mc->va) | PCIEX8_0_BASE;
 	} else {
 		dst_pa = dst_mc->pa;
@@ -245,6 +638,9 @@ int ndma_memcpy_buf_from_mc(struct neuron_device *nd, void *buffer, u32 dst_offs
 	dst_pa += dst_offset;
 
 	if (src_mc->mem_location == MEM_LOC_HOST) {
+		// a page backed chunk has no contiguous physical range behind its va
+		if (src_mc->pages)
+			return -EINVAL;
 		src_pa = virt_to_phys(src_mc->va) | PCIEX8_0_BASE;
 	} else {
 		src_pa = src_mc->pa;
@@ -255,69 +651,30 @@ int ndma_memcpy_buf_from_mc(struct neuron_device *nd, void *buffer, u32 dst_offs
 	return ndma_memcpy(nd, nc_id, src_pa, dst_pa, size);
 }
 
-/**
- * Check whether given address is allocated in host memory by given pid and in given ND.
- */
-static bool ndma_is_valid_host_mem_from_nd(pid_t pid, u8 nd_index, phys_addr_t pa)
-{
-	struct neuron_device *nd;
-	if (nd_index >= MAX_NEURON_DEVICE_COUNT)
-		return false;
-	nd = neuron_pci_get_device(nd_index);
-	if (nd == NULL)
-		return false;
-	if (pid != nd->current_pid)
-		return false;
-
-	return mpset_search_mc(&nd->mpset, pa) != NULL;
-}
-
 /**
  * Check whether given PA is valid host memory allocation.
+ *
+ * All host allocations are kept in one interval tree, so this is a single lookup no
+ * matter which device(chaining) the memory was allocated through.
  */
 static bool ndma_is_valid_host_mem(struct neuron_device *nd, phys_addr_t pa)
 {
-	bool found = false;
-	int i;
-
-	read_lock(&nd->mpset.rblock);
-	// common case - check whether the PA is allocated from the current ND
-	found = ndma_is_valid_host_mem_from_nd(nd->current_pid, nd->device_index, pa);
-	if (found)
-		goto done;
-	// chaining - check neighbor NDs
-	found = ndma_is_valid_host_mem_from_nd(nd->current_pid, nd->device_index - 1, pa);
-	if (found)
-		goto done;
-	found = ndma_is_valid_host_mem_from_nd(nd->current_pid, nd->device_index + 1, pa);
-	if (found)
-		goto done;
-	// check all devices
-	for (i = 0; i < MAX_NEURON_DEVICE_COUNT; i++) {
-		// skip already checked devices
-		if (i >= nd->device_index - 1 && i <= nd->device_index + 1)
-			continue;
-		found = ndma_is_valid_host_mem_from_nd(nd->current_pid, i, pa);
-		if (found)
-			goto done;
-	}
-
-done:
-	read_unlock(&nd->mpset.rblock);
+	// chunks record the allocating tgid, and descriptors are validated on the
+	// submitting process's ioctl path - per core claimers never set current_pid
+	bool found = mc_host_mem_valid(task_tgid_nr(current), pa);
 	if (!found)
 		pr_err("nd%d:invalid host memory(%#llx) in DMA descriptor\n", nd->device_index, pa);
 	return found;
 }
 
-int ndma_memcpy_dma_copy_descriptors(struct neuron_device *nd, void *buffer, u32 src_offset,
-				     struct mem_chunk *dst_mc, u32 dst_offset, u32 size,
+/** Check the validity of the desc physical addresses */
+static int ndma_validate_descriptors(struct neuron_device *nd, void *buffer, u32 size,
 				     u32 desc_type)
 {
 	u32 curr_size = size;
 	union udma_desc *desc = (union udma_desc *)buffer;
 	phys_addr_t pa;
 
-	// Check the validity of the desc physical addresses
 	while (curr_size > 0) {
 		if (desc_type == NEURON_DMA_QUEUE_TYPE_TX) {
 			pa = desc->tx.buf_ptr;
@@ -340,6 +697,18 @@ int ndma_memcpy_dma_copy_descriptors(struct neuron_device *nd, void *buffer, u32
 		curr_size = curr_size - sizeof(union udma_desc);
 		desc++;
 	}
+	return 0;
+}
+
+int ndma_memcpy_dma_copy_descriptors(struct neuron_device *nd, void *buffer, u32 src_offset,
+				     struct mem_chunk *dst_mc, u32 dst_offset, u32 size,
+				     u32 desc_type)
+{
+	int ret;
+
+	ret = ndma_validate_descriptors(nd, buffer, size, desc_type);
+	if (ret)
+		return ret;
 
 	if (dst_mc->mem_location == MEM_LOC_HOST) {
 		memcpy(dst_mc->va + dst_offset, buffer + src_offset, size);
@@ -349,6 +718,101 @@ int ndma_memcpy_dma_copy_descriptors(struct neuron_device *nd, void *buffer, u32
 	}
 }
 
+int ndma_memcpy_dma_copy_descriptors_user(struct neuron_device *nd, void __user *buffer,
+					  struct mem_chunk *dst_mc, u32 dst_offset, u32 size,
+					  u32 desc_type)
+{
+	struct mem_chunk *stage[2] = { NULL, NULL };
+	struct ndma_h2t_marker markers[2];
+	bool marker_valid[2] = { false, false };
+	int bi = 0; // staging buffer for the next slice
+	u32 offset = 0, copy_size, remaining = size;
+	int i, ret = 0, ret2;
+	struct ndma_eng *eng;
+	struct ndma_ring *ring;
+	int rid;
+	dma_addr_t dst_pa;
+	int eng_id;
+
+	if (dst_mc->mem_location == MEM_LOC_HOST) {
+		// queue is backed by host memory - no DMA to overlap with
+		ret = mc_stage_get(&nd->mpset, &stage[0], MAX_DMA_DESC_SIZE, dst_mc->nc_id);
+		if (ret)
+			return -ENOMEM;
+		while (remaining) {
+			copy_size = remaining < MAX_DMA_DESC_SIZE ? remaining : MAX_DMA_DESC_SIZE;
+			if (copy_from_user(stage[0]->va, buffer + offset, copy_size)) {
+				ret = -EFAULT;
+				break;
+			}
+			ret = ndma_validate_descriptors(nd, stage[0]->va, copy_size, desc_type);
+			if (ret)
+				break;
+			memcpy(dst_mc->va + dst_offset + offset, stage[0]->va, copy_size);
+			remaining -= copy_size;
+			offset += copy_size;
+		}
+		mc_stage_put(&stage[0]);
+		return ret;
+	}
+
+	ret = mc_stage_get(&nd->mpset, &stage[0], MAX_DMA_DESC_SIZE, dst_mc->nc_id);
+	if (ret)
+		return -ENOMEM;
+	ret = mc_stage_get(&nd->mpset, &stage[1], MAX_DMA_DESC_SIZE, dst_mc->nc_id);
+	if (ret) {
+		mc_stage_put(&stage[0]);
+		return -ENOMEM;
+	}
+
+	dst_pa = dst_mc->pa + dst_offset;
+	eng_id = DMA_ENG_IDX_H2T + (dst_mc->nc_id * V1_DMA_ENG_PER_NC);
+	eng = &(nd->ndma_engine[eng_id]);
+	ring = ndma_h2t_ring_acquire(eng, &rid);
+	while (remaining) {
+		copy_size = remaining < MAX_DMA_DESC_SIZE ? remaining : MAX_DMA_DESC_SIZE;
+		// the buffer can be refilled only once its previous slice landed on the device
+		if (marker_valid[bi]) {
+			ret = ndma_h2t_marker_wait(eng, ring, &markers[bi]);
+			marker_valid[bi] = false;
+			if (ret)
+				break;
+		}
+		// the copy and the validation walk overlap with the other slice's in-flight DMA
+		if (copy_from_user(stage[bi]->va, buffer + offset, copy_size)) {
+			ret = -EFAULT;
+			break;
+		}
+		ret = ndma_validate_descriptors(nd, stage[bi]->va, copy_size, desc_type);
+		if (ret)
+			break;
+		ret = ndma_memcpy64k(eng, ring, virt_to_phys(stage[bi]->va) | PCIEX8_0_BASE,
+				     dst_pa + offset, copy_size, true);
+		if (ret)
+			break;
+		ret = ndma_h2t_marker_post(eng, ring, 1, !marker_valid[bi ^ 1], &markers[bi]);
+		if (ret)
+			break;
+		marker_valid[bi] = true;
+		bi ^= 1;
+		remaining -= copy_size;
+		offset += copy_size;
+	}
+	// wait for the in flight slices, oldest first
+	for (i = 0; i < 2; i++, bi ^= 1) {
+		if (!marker_valid[bi])
+			continue;
+		ret2 = ndma_h2t_marker_wait(eng, ring, &markers[bi]);
+		marker_valid[bi] = false;
+		if (ret2 && !ret)
+			ret = ret2;
+	}
+	ndma_h2t_ring_release(eng, rid);
+	mc_stage_put(&stage[0]);
+	mc_stage_put(&stage[1]);
+	return ret;
+}
+
 static int ndmar_queue_read_state(struct udma_q *hw_q, struct neuron_dma_queue_state *result)
 {
 	u32 low, high;
@@ -407,3 +871,139 @@ int ndmar_queue_get_state(struct neuron_device *nd, int eng_id, int qid,
 
 	return ret;
 }
+
+/* Fill queue state from the driver's shadow of the ring pointers - no MMIO.
+ * The hardware fetch pointer is not shadowed, so the last acked completion
+ * index is reported as the head.
+ */
+static void ndmar_queue_read_state_sw(struct udma_q *hw_q, struct neuron_dma_queue_state *result)
+{
+	result->hw_status = hw_q->status;
+	result->sw_status = hw_q->status;
+	result->base_addr = hw_q->desc_phy_base;
+	result->length = hw_q->size;
+	result->head_pointer = hw_q->next_cdesc_idx;
+	result->tail_pointer = hw_q->next_desc_idx;
+	result->completion_base_addr = hw_q->cdesc_phy_base;
+	result->completion_head = hw_q->comp_head_idx;
+}
+
+int ndmar_eng_get_snapshot(struct neuron_device *nd, int eng_id, bool sw_only, u32 max_queues,
+			   struct neuron_dma_queue_state *tx, struct neuron_dma_queue_state *rx,
+			   u32 *num_queues)
+{
+	int ret;
+	u32 qid, count;
+	struct ndma_eng *eng;
+	struct udma *udma;
+
+	if (eng_id < 0 || eng_id >= NUM_DMA_ENG_PER_DEVICE)
+		return -EINVAL;
+
+	eng = &(nd->ndma_engine[eng_id]);
+	udma = &eng->udma;
+	count = udma->num_of_queues;
+	if (count > max_queues)
+		count = max_queues;
+	*num_queues = count;
+
+	for (qid = 0; qid < count; qid++) {
+		if (sw_only) {
+			ndmar_queue_read_state_sw(&udma->udma_q_m2s[qid], &tx[qid]);
+			ndmar_queue_read_state_sw(&udma->udma_q_s2m[qid], &rx[qid]);
+			continue;
+		}
+		ret = ndmar_queue_read_state(&udma->udma_q_m2s[qid], &tx[qid]);
+		if (ret)
+			return ret;
+		ret = ndmar_queue_read_state(&udma->udma_q_s2m[qid], &rx[qid]);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int ndma_benchmark(struct neuron_device *nd, u32 nc_id, u32 direction, u32 size, u32 iterations,
+		   u64 *total_nsec, u64 *desc_nsec, u64 *bandwidth)
+{
+	struct mem_chunk *src_mc = NULL, *dst_mc = NULL;
+	enum mem_location src_loc, dst_loc;
+	dma_addr_t src_pa, dst_pa;
+	ktime_t start;
+	u64 elapsed, descs, usec;
+	u32 i;
+	int ret;
+
+	if (nc_id >= V1_NC_PER_DEVICE || size == 0)
+		return -EINVAL;
+
+	switch (direction) {
+	case NEURON_DMA_BENCH_H2D:
+		src_loc = MEM_LOC_HOST;
+		dst_loc = MEM_LOC_DEVICE;
+		break;
+	case NEURON_DMA_BENCH_D2H:
+		src_loc = MEM_LOC_DEVICE;
+		dst_loc = MEM_LOC_HOST;
+		break;
+	case NEURON_DMA_BENCH_D2D:
+		src_loc = MEM_LOC_DEVICE;
+		dst_loc = MEM_LOC_DEVICE;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	// device buffers come from the benchmarked core's own DDR region so a per
+	// core owner stays confined to its arena, matching the allocation ioctl
+	ret = mc_alloc(&nd->mpset, &src_mc, size, src_loc, 0,
+		       src_loc == MEM_LOC_DEVICE ? nc_id : 0, nc_id);
+	if (ret)
+		return -ENOMEM;
+	ret = mc_alloc(&nd->mpset, &dst_mc, size, dst_loc, 0,
+		       dst_loc == MEM_LOC_DEVICE ? nc_id : 0, nc_id);
+	if (ret) {
+		mc_free(&src_mc);
+		return -ENOMEM;
+	}
+
+	// virt_to_phys() below needs physically contiguous buffers; a page backed
+	// fallback chunk only has a vmap'd va, so its benchmark would DMA garbage
+	if (src_mc->pages || dst_mc->pages) {
+		pr_err("no contiguous host memory for dma benchmark(%u bytes)\n", size);
+		ret = -ENOMEM;
+		goto done;
+	}
+
+	if (src_loc == MEM_LOC_HOST)
+		src_pa = virt_to_phys(src_mc->va) | PCIEX8_0_BASE;
+	else
+		src_pa = src_mc->pa;
+	if (dst_loc == MEM_LOC_HOST)
+		dst_pa = virt_to_phys(dst_mc->va) | PCIEX8_0_BASE;
+	else
+		dst_pa = dst_mc->pa;
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		ret = ndma_memcpy(nd, nc_id, src_pa, dst_pa, size);
+		if (ret)
+			goto done;
+	}
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	*total_nsec = elapsed;
+	descs = (u64)DIV_ROUND_UP(size, MAX_DMA_DESC_SIZE) * iterations;
+	*desc_nsec = div64_u64(elapsed, descs);
+	// bytes per usec == MB/sec
+	usec = div64_u64(elapsed, NSEC_PER_USEC);
+	if (usec == 0)
+		usec = 1;
+	*bandwidth = div64_u64((u64)size * iterations, usec);
+
+done:
+	mc_free(&src_mc);
+	mc_free(&dst_mc);
+	return ret;
+}
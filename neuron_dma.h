@@ -6,6 +6,8 @@
 #ifndef NEURON_DMA_H
 #define NEURON_DMA_H
 
+#include <linux/interrupt.h>
+
 #include "udma/udma.h"
 
 #include "neuron_mempool.h"
@@ -74,6 +76,26 @@ int ndma_memcpy_dma_copy_descriptors(struct neuron_device *nd, void *buffer, u32
 				     struct mem_chunk *dst_mc, u32 dst_offset, u32 size,
 				     u32 queue_type);
 
+/**
+ * ndma_memcpy_dma_copy_descriptors_user() - Copy dma descriptors from user space to mc
+ * which is backing a dma queue.
+ *
+ * Two staging buffers alternate so that one slice's copy_from_user and validation walk
+ * run while the previous slice's DMA to device memory is still in flight.
+ *
+ * @nd: neuron device which should be used for dma
+ * @buffer: user space buffer which contains the dma descriptors
+ * @dst_mc: mc which backs the dma queue
+ * @dst_offset: offset in the queue.
+ * @size: copy size.
+ * @queue_type: dma queue type(tx or rx)
+ *
+ * Return: 0 if copy succeeds, a negative error code otherwise.
+ */
+int ndma_memcpy_dma_copy_descriptors_user(struct neuron_device *nd, void __user *buffer,
+					  struct mem_chunk *dst_mc, u32 dst_offset, u32 size,
+					  u32 queue_type);
+
 /**
  * ndma_memcpy() - Copy data from one physical address to another physical address.
  *
@@ -87,6 +109,24 @@ int ndma_memcpy_dma_copy_descriptors(struct neuron_device *nd, void *buffer, u32
  */
 int ndma_memcpy(struct neuron_device *nd, u32 nc_id, dma_addr_t src, dma_addr_t dst, u32 size);
 
+/**
+ * ndma_memcpy_p2p() - Copy data from a memory chunk to a directly connected device's DRAM.
+ *
+ * The destination address is translated to the east/west PCIe window through which the
+ * peer is reachable, so the data moves device to device without host staging.
+ *
+ * @nd: neuron device which should be used for dma
+ * @src_mc: source memory chunk(host or device memory of nd)
+ * @src_offset: offset in the source chunk
+ * @peer_device_id: device index of the connected peer(from topology discovery)
+ * @dst: destination address in the peer's address space
+ * @size: copy size.
+ *
+ * Return: 0 if copy succeeds, a negative error code otherwise.
+ */
+int ndma_memcpy_p2p(struct neuron_device *nd, struct mem_chunk *src_mc, u32 src_offset,
+		    u32 peer_device_id, dma_addr_t dst, u32 size);
+
 /**
  * ndma_memcpy_wait_for_completion() - Wait for already initiated DMA transfer to complete.
  *
@@ -98,4 +138,34 @@ int ndma_memcpy(struct neuron_device *nd, u32 nc_id, dma_addr_t src, dma_addr_t
  */
 int ndma_memcpy_wait_for_completion(struct ndma_eng *eng, struct ndma_ring *ring, u32 count);
 
+/**
+ * ndma_h2t_irq_handler() - MSI-X handler for H2T DMA completion.
+ *
+ * @irq: irq number
+ * @data: dma engine which generated the interrupt
+ *
+ * Return: IRQ_HANDLED
+ */
+irqreturn_t ndma_h2t_irq_handler(int irq, void *data);
+
+/**
+ * ndma_benchmark() - Run timed DMA transfers entirely inside the kernel.
+ *
+ * Allocates source and destination buffers per the requested direction, runs
+ * the transfers over the H2T path and reports timing from kernel timestamps.
+ *
+ * @nd: neuron device to benchmark
+ * @nc_id: neuron core whose H2T engine runs the transfers
+ * @direction: transfer direction(enum neuron_dma_benchmark_dir)
+ * @size: bytes per transfer
+ * @iterations: number of timed transfers
+ * @total_nsec: wall time of all transfers is set here
+ * @desc_nsec: average time per DMA descriptor is set here
+ * @bandwidth: achieved bandwidth(MB/sec) is set here
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int ndma_benchmark(struct neuron_device *nd, u32 nc_id, u32 direction, u32 size, u32 iterations,
+		   u64 *total_nsec, u64 *desc_nsec, u64 *bandwidth);
+
 #endif
@@ -20,6 +20,10 @@ struct neuron_ioctl_mem_alloc {
 	__u64 *mem_handle; // [out] Allocated memory handle would stored here.
 };
 
+struct neuron_ioctl_nc_claim {
+	__u32 nc_id; // [in] NeuronCore to claim for the calling process
+};
+
 struct neuron_ioctl_device_init {
 	/* Splits DRAM in the device into smaller regions.
 	 * This improves performance of DDR by allowing parallel DMA using different regions.
@@ -37,6 +41,17 @@ struct neuron_ioctl_mem_free {
 	__u64 mem_handle; // [in] Memory handle to be freed.
 };
 
+struct neuron_ioctl_mem_get_mmap_offset {
+	__u64 mem_handle; // [in] Memory handle to be memory mapped.
+	__u64 mmap_offset; // [out] mmap() offset for the memory chunk.
+};
+
+struct neuron_ioctl_mem_register {
+	__u64 va; // [in] User virtual address of the buffer to pin(need not be page aligned)
+	__u64 size; // [in] Buffer size in bytes
+	__u64 *mem_handle; // [out] Memory handle for the registered buffer.
+};
+
 struct neuron_ioctl_mem_copy {
 	__u64 src_mem_handle; // [in] Source memory handle from where data is copied.
 	__u64 dst_mem_handle; // [in] Destination memory handle to data is to be copied.
@@ -45,6 +60,30 @@ struct neuron_ioctl_mem_copy {
 	__u32 dst_offset; // [in] Offset in the destination memory handle.
 };
 
+struct neuron_ioctl_mem_copy_p2p {
+	__u64 src_mem_handle; // [in] Source memory handle on this device.
+	__u64 dst_mem_handle; // [in] Destination memory handle on the peer device.
+	__u32 dst_device; // [in] Device index of the connected peer device.
+	__u32 size; // [in] Size of the transfer.
+	__u32 src_offset; // [in] Offset in the source memory handle.
+	__u32 dst_offset; // [in] Offset in the destination memory handle.
+};
+
+struct neuron_ioctl_mem_copy_async {
+	__u64 src_mem_handle; // [in] Source memory handle from where data is copied.
+	__u64 dst_mem_handle; // [in] Destination memory handle to data is to be copied.
+	__u32 size; // [in] Size of the transfer.
+	__u32 src_offset; // [in] Offset in the source memory handle.
+	__u32 dst_offset; // [in] Offset in the destination memory handle.
+	__s32 eventfd; // [in] eventfd signaled when the transfer completes(-1 to disable signaling)
+	__u64 transfer_id; // [out] Id for querying the transfer status.
+};
+
+struct neuron_ioctl_mem_copy_async_status {
+	__u64 transfer_id; // [in] Id returned by NEURON_IOCTL_MEM_COPY_ASYNC.
+	__s32 status; // [out] 0 if completed, -EBUSY if in flight, a negative error code on failure.
+};
+
 struct neuron_ioctl_mem_buf_copy {
 	__u64 mem_handle; // [in] Source or Destination memory handle from/to data needs to be copied.
 	void *buffer; // [in] Buffer from/to where data to be copied.
@@ -53,6 +92,22 @@ struct neuron_ioctl_mem_buf_copy {
 	__u32 copy_to_mem_handle; // [in] if set to True copies from buffer to memhandle else copies from memhandle to buffer.
 };
 
+struct neuron_ioctl_mem_buf_copy_entry {
+	__u64 mem_handle; // [in] Source or Destination memory handle from/to data needs to be copied.
+	void *buffer; // [in] Buffer from/to where data to be copied.
+	__u32 size; // [in] Size of the data to be copied.
+	__u32 offset; // [in] Offset in the memory handle where the data to be written/read.
+	__u32 copy_to_mem_handle; // [in] if set to True copies from buffer to memhandle else copies from memhandle to buffer.
+};
+
+// maximum number of entries in one scatter-gather buffer copy
+#define NEURON_MEM_BUF_COPY_SG_MAX_ENTRIES 16384
+
+struct neuron_ioctl_mem_buf_copy_sg {
+	__u32 count; // [in] Number of entries in the array.
+	struct neuron_ioctl_mem_buf_copy_entry *entries; // [in] Array of copy operations.
+};
+
 struct neuron_ioctl_bar_rw {
 	__u32 bar; // [in] BAR index
 	__u64 *address; // [in] Array of register addresses.
@@ -79,6 +134,20 @@ struct neuron_ioctl_dma_copy_descriptors {
 	enum neuron_dma_queue_type queue_type; // [in] specifies whether it is RX/TX queue
 };
 
+struct neuron_ioctl_dma_program_register {
+	__u32 eng_id; // [in] DMA engine index
+	__u32 qid; // [in] Queue index in the DMA engine
+	void *tx_buffer; // [in] TX descriptors to load into the queue(NULL to skip TX)
+	void *rx_buffer; // [in] RX descriptors to load into the queue(NULL to skip RX)
+	__u32 tx_desc_count; // [in] Number of TX descriptors in tx_buffer
+	__u32 rx_desc_count; // [in] Number of RX descriptors in rx_buffer
+	__u64 program_handle; // [out] Handle for triggering the program.
+};
+
+struct neuron_ioctl_dma_program_trigger {
+	__u64 program_handle; // [in] Handle returned by NEURON_IOCTL_DMA_PROGRAM_REGISTER.
+};
+
 struct neuron_ioctl_dma_queue_init {
 	__u32 eng_id; // [in] DMA engine index
 	__u32 qid; // [in] Queue index in the DMA engine
@@ -108,6 +177,30 @@ struct neuron_ioctl_dma_queue_copy_start {
 	__u32 rx_desc_count; // [in] number of rx desc's need to be allocated
 };
 
+/** Operations which can be submitted through NEURON_IOCTL_DMA_SUBMIT_BATCH */
+enum neuron_dma_batch_op {
+	NEURON_DMA_BATCH_COPY_DESCRIPTORS = 1, // same as NEURON_IOCTL_DMA_COPY_DESCRIPTORS
+	NEURON_DMA_BATCH_COPY_START, // same as NEURON_IOCTL_DMA_QUEUE_COPY_START
+	NEURON_DMA_BATCH_ACK_COMPLETED, // same as NEURON_IOCTL_DMA_ACK_COMPLETED
+};
+
+struct neuron_ioctl_dma_batch_entry {
+	__u32 op; // [in] operation to execute(enum neuron_dma_batch_op)
+	union {
+		struct neuron_ioctl_dma_copy_descriptors copy_descriptors;
+		struct neuron_ioctl_dma_queue_copy_start copy_start;
+		struct neuron_ioctl_dma_ack_completed ack_completed;
+	};
+};
+
+// maximum number of entries in one batch
+#define NEURON_DMA_BATCH_MAX_ENTRIES 256
+
+struct neuron_ioctl_dma_submit_batch {
+	__u32 count; // [in] number of entries in the batch
+	struct neuron_ioctl_dma_batch_entry *entries; // [in] operations, executed in order
+};
+
 struct neuron_ioctl_dma_eng_init {
 	__u32 eng_id; // [in] DMA engine index
 };
@@ -148,6 +241,32 @@ struct neuron_ioctl_dma_queue_get_state {
 	struct neuron_dma_queue_state *rx; // [out] tx queue state
 };
 
+/** Transfer direction for NEURON_IOCTL_DMA_BENCHMARK */
+enum neuron_dma_benchmark_dir {
+	NEURON_DMA_BENCH_H2D = 0, // host to device
+	NEURON_DMA_BENCH_D2H, // device to host
+	NEURON_DMA_BENCH_D2D, // device to device
+};
+
+struct neuron_ioctl_dma_benchmark {
+	__u32 nc_id; // [in] Neuron core whose H2T engine runs the transfers
+	__u32 direction; // [in] transfer direction(enum neuron_dma_benchmark_dir)
+	__u32 size; // [in] bytes per transfer
+	__u32 iterations; // [in] number of timed transfers
+	__u64 total_nsec; // [out] wall time for all transfers
+	__u64 desc_nsec; // [out] average time per DMA descriptor
+	__u64 bandwidth; // [out] achieved bandwidth in MB/sec
+};
+
+struct neuron_ioctl_dma_eng_snapshot {
+	__u32 eng_id; // [in] DMA engine index
+	__u32 sw_only; // [in] 1 - fill from the driver's ring pointer shadows, no hardware access
+	__u32 max_queues; // [in] capacity of the tx and rx arrays(in queue states)
+	__u32 num_queues; // [out] number of queue pairs captured
+	struct neuron_dma_queue_state *tx; // [out] per queue tx state, num_queues entries
+	struct neuron_dma_queue_state *rx; // [out] per queue rx state, num_queues entries
+};
+
 struct neuron_ioctl_dma_descriptor_copyout {
 	__u32 eng_id; // [in] DMA engine index
 	__u32 qid; // [in] Queue index in the DMA engine
@@ -169,6 +288,34 @@ struct neuron_ioctl_event {
 	__u32 value; //[in/out] Value to read/write
 };
 
+enum neuron_sync_op {
+	NEURON_SYNC_OP_SEMAPHORE_READ = 0,
+	NEURON_SYNC_OP_SEMAPHORE_WRITE,
+	NEURON_SYNC_OP_SEMAPHORE_INCREMENT,
+	NEURON_SYNC_OP_SEMAPHORE_DECREMENT,
+	NEURON_SYNC_OP_EVENT_GET,
+	NEURON_SYNC_OP_EVENT_SET,
+};
+
+struct neuron_ioctl_sync_op {
+	__u32 nc_id; // [in] Neuron Core Index
+	__u32 op; // [in] One of NEURON_SYNC_OP_*
+	__u32 index; // [in] Semaphore or event index
+	__u32 value; // [in/out] Value to write / value read
+};
+
+#define NEURON_SEMAPHORE_EVENT_BATCH_MAX_OPS 1024
+
+struct neuron_ioctl_semaphore_event_batch {
+	__u32 count; // [in] Number of operations
+	struct neuron_ioctl_sync_op *ops; // [in/out] Operations, executed in order
+};
+
+struct neuron_ioctl_sync_mmap_offset {
+	__u32 nc_id; // [in] Neuron Core Index
+	__u64 mmap_offset; // [out] Offset to pass to mmap() for the core's sync window
+};
+
 struct neuron_ioctl_notifications_init {
 	__u32 nc_id; // [in] Neuron Core Index
 	__u32 nq_type; // [in] Notification queue type
@@ -181,6 +328,14 @@ struct neuron_ioctl_notifications_destroy {
 	__u64 mmap_offset; // [in] NQ's mmap offset
 };
 
+struct neuron_ioctl_notifications_watch {
+	__u32 nc_id; // [in] Neuron Core Index
+	__u32 nq_type; // [in] Notification queue type
+	__u32 engine_index; // [in] Engine Index.
+	__u32 read_offset; // [in] Offset of the next unread entry in the queue
+	__u32 watch; // [in] 1 to arm the watch, 0 to cancel it
+};
+
 struct neuron_ioctl_read_hw_counters {
 	__u64 *address; // [in] Array of register addresses.
 	__u32 *data; // [iout] Buffer from where to data written.
@@ -198,6 +353,10 @@ struct neuron_ioctl_device_info {
 	__u64 bar_size[NEURON_MAX_BARS]; // [out] Size of the bar
 };
 
+struct neuron_ioctl_device_numa_node {
+	__s32 numa_node; // [out] NUMA node of the device(-1 if unknown)
+};
+
 #define NEURON_IOCTL_BASE 'N'
 
 /** Send "Reset" Request to the hardware.
@@ -222,6 +381,15 @@ struct neuron_ioctl_device_info {
 /** Returns current application pid using the device. */
 #define NEURON_IOCTL_DEVICE_APP_PID _IOR(NEURON_IOCTL_BASE, 6, __s32)
 
+/** Claims a single NeuronCore for the calling process instead of the whole device.
+ *  Independent processes can each claim different cores of one device; claims are
+ *  released when the claiming process closes the device node. Can not be mixed with
+ *  NEURON_IOCTL_DEVICE_INIT from a different process - a whole device claim excludes
+ *  core level sharing and vice versa. The first claim splits the device memory into
+ *  one region per NeuronCore so each process allocates from its own arena.
+ */
+#define NEURON_IOCTL_NC_CLAIM _IOR(NEURON_IOCTL_BASE, 58, struct neuron_ioctl_nc_claim *)
+
 /** Read from BAR */
 #define NEURON_IOCTL_BAR_READ _IOR(NEURON_IOCTL_BASE, 11, struct neuron_ioctl_bar_rw *)
 /** Write to BAR */
@@ -241,6 +409,33 @@ struct neuron_ioctl_device_info {
  *  This can be used by applications to DMA.
  */
 #define NEURON_IOCTL_MEM_GET_PA _IOR(NEURON_IOCTL_BASE, 25, struct neuron_ioctl_mem_get_pa *)
+/** Returns mmap() offset for given memory_handle.
+ *  Host memory is mapped directly(zero-copy access); device memory can be mapped only
+ *  if it is reachable through the BAR aperture.
+ */
+#define NEURON_IOCTL_MEM_GET_MMAP_OFFSET _IOWR(NEURON_IOCTL_BASE, 26, struct neuron_ioctl_mem_get_mmap_offset *)
+/** Pins given user buffer for zero-copy DMA and returns a memory_handle for it.
+ *  The handle can be used in NEURON_IOCTL_MEM_COPY and in DMA descriptors;
+ *  NEURON_IOCTL_MEM_FREE unpins the buffer.
+ */
+#define NEURON_IOCTL_MEM_REGISTER _IOR(NEURON_IOCTL_BASE, 27, struct neuron_ioctl_mem_register *)
+/** Executes an array of buffer copies in one syscall. Adjacent device ranges are
+ *  packed into shared DMA transfers and one staging buffer is reused for the whole
+ *  batch, so loading a model of many small tensors needs one kernel entry.
+ */
+#define NEURON_IOCTL_MEM_BUF_COPY_SG _IOR(NEURON_IOCTL_BASE, 57, struct neuron_ioctl_mem_buf_copy_sg *)
+/** Copy data to device memory of a directly connected device. (using DMA over the
+ *  east/west PCIe link, without staging through host memory)
+ */
+#define NEURON_IOCTL_MEM_COPY_P2P _IOR(NEURON_IOCTL_BASE, 28, struct neuron_ioctl_mem_copy_p2p *)
+/** Start a DMA copy between two memory handles and return without waiting for it.
+ *  Completion is signaled on the given eventfd and can be queried(and the transfer id
+ *  reaped) with NEURON_IOCTL_MEM_COPY_ASYNC_STATUS. Both memory handles are pinned
+ *  while the transfer is in flight; freeing one before completion fails with EBUSY.
+ */
+#define NEURON_IOCTL_MEM_COPY_ASYNC _IOWR(NEURON_IOCTL_BASE, 49, struct neuron_ioctl_mem_copy_async *)
+/** Query(and on completion release) the status of an asynchronous DMA copy. */
+#define NEURON_IOCTL_MEM_COPY_ASYNC_STATUS _IOWR(NEURON_IOCTL_BASE, 50, struct neuron_ioctl_mem_copy_async_status *)
 
 
 /** Initialize DMA engine. */
@@ -263,6 +458,28 @@ struct neuron_ioctl_device_info {
 #define NEURON_IOCTL_DMA_COPY_DESCRIPTORS _IOR(NEURON_IOCTL_BASE, 38, struct neuron_ioctl_dma_copy_descriptors *)
 /** Copy descriptors in the Queue to host memory */
 #define NEURON_IOCTL_DMA_DESCRIPTOR_COPYOUT _IOWR(NEURON_IOCTL_BASE, 39, struct neuron_ioctl_dma_descriptor_copyout *)
+/** Executes an array of descriptor copy/copy start/ack operations in one syscall */
+#define NEURON_IOCTL_DMA_SUBMIT_BATCH _IOR(NEURON_IOCTL_BASE, 40, struct neuron_ioctl_dma_submit_batch *)
+/** Returns the state of every queue in a DMA engine in one syscall.
+ *  With sw_only set the state comes from the driver's shadow of the ring pointers,
+ *  so periodic sampling does not generate MMIO reads.
+ */
+#define NEURON_IOCTL_DMA_ENG_SNAPSHOT _IOWR(NEURON_IOCTL_BASE, 47, struct neuron_ioctl_dma_eng_snapshot *)
+/** Runs timed DMA transfers fully inside the kernel and reports bandwidth and
+ *  per-descriptor latency, free of syscall and allocator noise.
+ */
+#define NEURON_IOCTL_DMA_BENCHMARK _IOWR(NEURON_IOCTL_BASE, 48, struct neuron_ioctl_dma_benchmark *)
+/** Validate and load a descriptor program into a DMA queue once and return a handle.
+ *  The descriptors stay in the queue's backing memory, so re-executing the program
+ *  needs neither descriptor copies nor validation.
+ */
+#define NEURON_IOCTL_DMA_PROGRAM_REGISTER _IOWR(NEURON_IOCTL_BASE, 54, struct neuron_ioctl_dma_program_register *)
+/** Re-execute a registered descriptor program - rewinds the queue's ring pointers
+ *  and rings the doorbell.
+ */
+#define NEURON_IOCTL_DMA_PROGRAM_TRIGGER _IOR(NEURON_IOCTL_BASE, 55, struct neuron_ioctl_dma_program_trigger *)
+/** Release a registered descriptor program. */
+#define NEURON_IOCTL_DMA_PROGRAM_UNREGISTER _IOR(NEURON_IOCTL_BASE, 56, struct neuron_ioctl_dma_program_trigger *)
 
 /** Increment, decrement, get and set operations on NeuronCore's sempahore and events
  *  Applications can use semaphore and event to synchronize with host software.
@@ -274,11 +491,30 @@ struct neuron_ioctl_device_info {
 #define NEURON_IOCTL_EVENT_SET _IOR(NEURON_IOCTL_BASE, 45, struct neuron_ioctl_semaphore *)
 #define NEURON_IOCTL_EVENT_GET _IOWR(NEURON_IOCTL_BASE, 46, struct neuron_ioctl_semaphore *)
 
+/** Executes an array of semaphore/event operations in one kernel entry. */
+#define NEURON_IOCTL_SEMAPHORE_EVENT_BATCH _IOWR(NEURON_IOCTL_BASE, 59, struct neuron_ioctl_semaphore_event_batch *)
+
+/** Returns the mmap() offset of a core's read-only synchronization window.
+ *  The window starts at the event registers; the semaphore read registers follow
+ *  at offset 0x1000. Mapping it lets applications poll with a load instead of an
+ *  ioctl - updates must still go through the ioctls above.
+ */
+#define NEURON_IOCTL_SYNC_MMAP_OFFSET _IOWR(NEURON_IOCTL_BASE, 60, struct neuron_ioctl_sync_mmap_offset *)
+
 /** Initializes notification queues in the neuron core. */
 #define NEURON_IOCTL_NOTIFICATIONS_INIT _IOR(NEURON_IOCTL_BASE, 51, struct neuron_ioctl_notifications_init *)
 #define NEURON_IOCTL_NOTIFICATIONS_DESTROY _IOR(NEURON_IOCTL_BASE, 52, struct neuron_ioctl_notifications_destroy *)
+/** Arms a watch on a notification queue so poll() reports the fd readable once the
+ *  hardware writes an entry at the given read offset - no busy-polling of the ring.
+ */
+#define NEURON_IOCTL_NOTIFICATIONS_WATCH _IOR(NEURON_IOCTL_BASE, 53, struct neuron_ioctl_notifications_watch *)
 
 /** Gets the HW counters */
 #define NEURON_IOCTL_READ_HW_COUNTERS _IOR(NEURON_IOCTL_BASE, 61, struct neuron_ioctl_read_hw_counters *)
 
+/** Returns the NUMA node of the device's PCIe root port, so applications can pin
+ *  threads and allocate host memory on the right socket.
+ */
+#define NEURON_IOCTL_DEVICE_NUMA_NODE _IOWR(NEURON_IOCTL_BASE, 62, struct neuron_ioctl_device_numa_node *)
+
 #endif
@@ -11,9 +11,14 @@
 #include <linux/kernel.h>
 #include <linux/mutex.h>
 #include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/version.h>
 #include <linux/slab.h>
 #include <linux/types.h>
 #include <linux/dma-mapping.h>
+#include <linux/device.h>
+#include <linux/vmalloc.h>
 #include <linux/fault-inject.h>
 
 #include "neuron_mempool.h"
@@ -24,6 +29,12 @@ int mempool_min_alloc_size = 256;
 module_param(mempool_min_alloc_size, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 MODULE_PARM_DESC(mempool_min_alloc_size, "Minimum size for device memory allocation");
 
+int mempool_host_cache_size = 64 * 1024 * 1024;
+
+module_param(mempool_host_cache_size, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(mempool_host_cache_size,
+		 "Maximum bytes of freed host DMA buffers cached per device for reuse(0 disables caching)");
+
 #ifdef CONFIG_FAULT_INJECTION
 DECLARE_FAULT_ATTR(neuron_fail_mc_alloc);
 #endif
@@ -31,6 +42,124 @@ DECLARE_FAULT_ATTR(neuron_fail_mc_alloc);
 // Limit for using kmalloc
 #define MEMPOOL_KMALLOC_MAX_SIZE (256 * 1024)
 
+// slab cache for struct mem_chunk - these are allocated and freed constantly
+static struct kmem_cache *mc_cache;
+
+int mpset_module_init(void)
+{
+	mc_cache = kmem_cache_create("neuron_mem_chunk", sizeof(struct mem_chunk), 0, 0, NULL);
+	if (mc_cache == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+void mpset_module_exit(void)
+{
+	kmem_cache_destroy(mc_cache);
+	mc_cache = NULL;
+}
+
+/* One recycled coherent host buffer. Freed large host chunks park their backing memory
+ * here(under mpset->lock) so the next allocation of the same size class skips
+ * dma_alloc_coherent() entirely.
+ */
+struct mp_host_cache_entry {
+	struct list_head list;
+	void *va;
+	dma_addr_t pa;
+	u32 size;
+};
+
+// smallest cached class - first power of two above MEMPOOL_KMALLOC_MAX_SIZE
+#define MP_HOST_CACHE_MIN_ORDER 19
+
+/**
+ * Map an allocation size to a cache size class, -1 if the size is not cacheable.
+ */
+static int mp_host_cache_class(u64 size)
+{
+	int order = order_base_2(size);
+
+	if (order < MP_HOST_CACHE_MIN_ORDER)
+		order = MP_HOST_CACHE_MIN_ORDER;
+	if (order - MP_HOST_CACHE_MIN_ORDER >= MP_HOST_CACHE_CLASSES)
+		return -1;
+	return order - MP_HOST_CACHE_MIN_ORDER;
+}
+
+/**
+ * Take a cached buffer of given size class if one is available.
+ * Must be called with mpset->lock held.
+ */
+static bool mp_host_cache_get(struct mempool_set *mpset, u32 size, struct mem_chunk *mc)
+{
+	struct mp_host_cache_entry *entry;
+	int class = mp_host_cache_class(size);
+
+	if (class < 0 || list_empty(&mpset->host_cache_head[class]))
+		return false;
+	entry = list_first_entry(&mpset->host_cache_head[class], struct mp_host_cache_entry, list);
+	list_del(&entry->list);
+	mpset->host_cache_size -= entry->size;
+	mc->va = entry->va;
+	mc->pa = entry->pa;
+	// the buffer was owned by an arbitrary process before, scrub it
+	memset(mc->va, 0, entry->size);
+	kfree(entry);
+	return true;
+}
+
+/**
+ * Park a freed buffer in the cache. Returns false if the buffer is not cacheable or the
+ * cache is at its watermark, in which case the caller frees the backing memory.
+ * Must be called with mpset->lock held.
+ */
+static bool mp_host_cache_put(struct mempool_set *mpset, struct mem_chunk *mc)
+{
+	struct mp_host_cache_entry *entry;
+	int class = mp_host_cache_class(mc->size);
+
+	if (class < 0 || mc->size != (1u << (class + MP_HOST_CACHE_MIN_ORDER)))
+		return false;
+	if (mempool_host_cache_size <= 0 ||
+	    mpset->host_cache_size + mc->size > mempool_host_cache_size)
+		return false;
+	entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+	if (entry == NULL)
+		return false;
+	entry->va = mc->va;
+	entry->pa = mc->pa;
+	entry->size = mc->size;
+	list_add(&entry->list, &mpset->host_cache_head[class]);
+	mpset->host_cache_size += mc->size;
+	return true;
+}
+
+/**
+ * Return all cached buffers to the system. Must be called with mpset->lock held.
+ */
+static void mp_host_cache_drain(struct mempool_set *mpset)
+{
+	struct mp_host_cache_entry *entry, *next;
+	int i;
+
+	for (i = 0; i < MP_HOST_CACHE_CLASSES; i++) {
+		list_for_each_entry_safe (entry, next, &mpset->host_cache_head[i], list) {
+			list_del(&entry->list);
+			dma_free_coherent(mpset->pdev, entry->size, entry->va, entry->pa);
+			kfree(entry);
+		}
+	}
+	mpset->host_cache_size = 0;
+}
+
+/* Host allocations of every device are indexed in a single interval tree - host physical
+ * addresses are unique system wide, so DMA descriptor validation is one lookup no matter
+ * which device the memory was allocated through.
+ */
+static struct rb_root mc_host_root = RB_ROOT;
+static DEFINE_RWLOCK(mc_host_lock);
+
 /**
  * mc_insert_node() - Insert a mem chunk to the tree
  *
@@ -70,6 +199,171 @@ void mc_remove_node(struct rb_root *root, struct mem_chunk *mc)
 	rb_erase(&mc->node, root);
 }
 
+/**
+ * Merge the pages of a chunk into physically contiguous runs and index each run in the
+ * host interval tree so DMA descriptor validation accepts the memory.
+ *
+ * @page_off: offset of the buffer start in the first page
+ * @size: buffer size in bytes
+ */
+static int mc_index_page_runs(struct mempool_set *mpset, struct mem_chunk *mc, u64 page_off,
+			      u64 size)
+{
+	u64 covered, run_bytes;
+	phys_addr_t run_pa;
+	u32 i, r, nr_runs;
+	u32 nr_pages = mc->nr_pages;
+
+	// merge physically adjacent pages into runs
+	nr_runs = 1;
+	for (i = 1; i < nr_pages; i++) {
+		if (page_to_phys(mc->pages[i]) != page_to_phys(mc->pages[i - 1]) + PAGE_SIZE)
+			nr_runs++;
+	}
+	mc->runs = kvmalloc(nr_runs * sizeof(struct mem_chunk *), GFP_KERNEL);
+	if (mc->runs == NULL)
+		return -ENOMEM;
+	memset(mc->runs, 0, nr_runs * sizeof(struct mem_chunk *));
+	mc->nr_runs = nr_runs;
+
+	covered = 0; // bytes of the buffer assigned to finished runs
+	run_pa = page_to_phys(mc->pages[0]) + page_off;
+	run_bytes = min(size, (u64)(PAGE_SIZE - page_off));
+	for (i = 1, r = 0; i <= nr_pages; i++) {
+		struct mem_chunk *run;
+		if (i < nr_pages &&
+		    page_to_phys(mc->pages[i]) == page_to_phys(mc->pages[i - 1]) + PAGE_SIZE) {
+			run_bytes += min(size - (covered + run_bytes), (u64)PAGE_SIZE);
+			continue;
+		}
+		run = kmem_cache_zalloc(mc_cache, GFP_KERNEL);
+		if (run == NULL)
+			return -ENOMEM;
+		run->pa = run_pa;
+		run->size = run_bytes;
+		run->run_offset = covered;
+		run->pid = mc->pid;
+		run->mpset = mpset;
+		run->mem_location = MEM_LOC_HOST;
+		mc->runs[r++] = run;
+		write_lock(&mc_host_lock);
+		mc_insert_node(&mc_host_root, run);
+		write_unlock(&mc_host_lock);
+		covered += run_bytes;
+		if (i < nr_pages) {
+			run_pa = page_to_phys(mc->pages[i]);
+			run_bytes = min(size - covered, (u64)PAGE_SIZE);
+		}
+	}
+	return 0;
+}
+
+/**
+ * Remove the run index entries of a page backed chunk from the host interval tree.
+ */
+static void mc_drop_runs(struct mem_chunk *mc)
+{
+	u32 i;
+
+	for (i = 0; i < mc->nr_runs; i++) {
+		struct mem_chunk *run = mc->runs[i];
+		if (run == NULL)
+			continue;
+		write_lock(&mc_host_lock);
+		mc_remove_node(&mc_host_root, run);
+		write_unlock(&mc_host_lock);
+		kmem_cache_free(mc_cache, run);
+	}
+	kvfree(mc->runs);
+	mc->runs = NULL;
+	mc->nr_runs = 0;
+}
+
+/**
+ * Remove the run index entries of a registered user memory chunk and unpin its pages.
+ */
+static void mc_unpin_user_mem(struct mem_chunk *mc)
+{
+	u32 i;
+
+	mc_drop_runs(mc);
+
+	for (i = 0; i < mc->nr_pages; i++) {
+		set_page_dirty_lock(mc->pages[i]);
+		put_page(mc->pages[i]);
+	}
+	kvfree(mc->pages);
+	mc->pages = NULL;
+	mc->nr_pages = 0;
+}
+
+/**
+ * Back a large host chunk with order-0 pages when a contiguous allocation is not
+ * available. The pages are merged into runs and indexed like registered user memory,
+ * so DMA consumers iterate the runs and nothing needs to be physically contiguous;
+ * vmap() provides a kernel mapping so buffer copies work unchanged.
+ */
+static int mc_alloc_host_sg(struct mempool_set *mpset, struct mem_chunk *mc, u32 size)
+{
+	u32 nr_pages = DIV_ROUND_UP(size, PAGE_SIZE);
+	u32 i;
+	int ret;
+
+	mc->pages = kvmalloc(nr_pages * sizeof(struct page *), GFP_KERNEL);
+	if (mc->pages == NULL)
+		return -ENOMEM;
+	memset(mc->pages, 0, nr_pages * sizeof(struct page *));
+	for (i = 0; i < nr_pages; i++) {
+		mc->pages[i] = alloc_pages_node(mpset->numa_node,
+						GFP_KERNEL | GFP_DMA32 | __GFP_ZERO, 0);
+		if (mc->pages[i] == NULL) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+		mc->nr_pages++;
+	}
+	mc->va = vmap(mc->pages, nr_pages, VM_MAP, PAGE_KERNEL);
+	if (mc->va == NULL) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+	ret = mc_index_page_runs(mpset, mc, 0, size);
+	if (ret)
+		goto fail;
+	mc->pa = mc->runs[0]->pa;
+	return 0;
+
+fail:
+	if (mc->va) {
+		vunmap(mc->va);
+		mc->va = NULL;
+	}
+	mc_drop_runs(mc);
+	for (i = 0; i < mc->nr_pages; i++)
+		__free_page(mc->pages[i]);
+	kvfree(mc->pages);
+	mc->pages = NULL;
+	mc->nr_pages = 0;
+	return ret;
+}
+
+/**
+ * Release an order-0 page backed host chunk allocated by mc_alloc_host_sg().
+ */
+static void mc_free_host_sg(struct mem_chunk *mc)
+{
+	u32 i;
+
+	vunmap(mc->va);
+	mc->va = NULL;
+	mc_drop_runs(mc);
+	for (i = 0; i < mc->nr_pages; i++)
+		__free_page(mc->pages[i]);
+	kvfree(mc->pages);
+	mc->pages = NULL;
+	mc->nr_pages = 0;
+}
+
 /**
  * mp_init() Initialize the mempool structure with given values.
  * Creates a backing gen_pool if the mem_location is device DRAM.
@@ -93,10 +387,14 @@ static int mp_init(struct mempool *mp, u64 start_addr, size_t pool_size,
 	mp->mem_location = mem_location;
 	mp->dram_channel = dram_channel;
 	mp->dram_region = dram_region;
+	mutex_init(&mp->lock);
 	INIT_LIST_HEAD(&mp->device_allocated_head);
 	mp->gen_pool = gen_pool_create(ilog2(mempool_min_alloc_size), -1);
 	if (mp->gen_pool == NULL)
 		return -ENOMEM;
+	// best fit keeps long-running mixed size workloads from fragmenting the pool
+	// the way the default first fit does
+	gen_pool_set_algo(mp->gen_pool, gen_pool_best_fit, NULL);
 
 	// 0 is special since we cant differentiate failure(NULL) in gen_pool_alloc().
 	// so avoid starting at 0 by sacrificing first chunk.
@@ -117,6 +415,39 @@ static int mp_init(struct mempool *mp, u64 start_addr, size_t pool_size,
 	return 0;
 }
 
+/**
+ * Scans one gen_pool chunk for its longest run of free allocation units.
+ */
+static void mp_largest_free_chunk_cb(struct gen_pool *pool, struct gen_pool_chunk *chunk,
+				     void *data)
+{
+	size_t *largest = data;
+	unsigned long nbits = (chunk->end_addr - chunk->start_addr + 1) >> pool->min_alloc_order;
+	unsigned long start = 0, free_start, free_end;
+
+	while (start < nbits) {
+		free_start = find_next_zero_bit(chunk->bits, nbits, start);
+		if (free_start >= nbits)
+			break;
+		free_end = find_next_bit(chunk->bits, nbits, free_start);
+		if (((free_end - free_start) << pool->min_alloc_order) > *largest)
+			*largest = (free_end - free_start) << pool->min_alloc_order;
+		start = free_end + 1;
+	}
+}
+
+size_t mp_largest_free_extent(struct mempool *mp)
+{
+	size_t largest = 0;
+
+	if (!mp->initialized || mp->gen_pool == NULL)
+		return 0;
+	// the bitmap is scanned without the pool's lock; the result is a statistic,
+	// not a guarantee that the extent is still free
+	gen_pool_for_each_chunk(mp->gen_pool, mp_largest_free_chunk_cb, &largest);
+	return largest;
+}
+
 /**
  * Frees all the chunks associated with the mempool.
  */
@@ -130,6 +461,7 @@ static void mp_free_device_mem(struct mempool *mp)
 		// Free all entries
 		struct list_head *this, *next;
 
+		mutex_lock(&mp->lock);
 		list_for_each_safe (this, next, &mp->device_allocated_head) {
 			struct mem_chunk *mc =
 				list_entry(this, struct mem_chunk, device_allocated_list);
@@ -137,10 +469,12 @@ static void mp_free_device_mem(struct mempool *mp)
 				gen_pool_free(mp->gen_pool, (unsigned long)mc->va, mc->size);
 				mc->va = NULL;
 			}
+			idr_remove(&mc->mpset->mc_handle_idr, mc->handle);
 			list_del(&mc->device_allocated_list);
-			kfree(mc);
+			kmem_cache_free(mc_cache, mc);
 		}
 		mp->allocated_size = 0;
+		mutex_unlock(&mp->lock);
 	}
 }
 
@@ -162,12 +496,35 @@ static void mp_destroy(struct mempool *mp)
 
 int mpset_host_init(struct mempool_set *mpset)
 {
+	int i;
+
 	mutex_init(&mpset->lock);
+	// allocate host DMA buffers on the socket the device hangs off of
+	mpset->numa_node = mpset->pdev ? dev_to_node(mpset->pdev) : NUMA_NO_NODE;
 	INIT_LIST_HEAD(&mpset->host_allocated_head);
-	mpset->root = RB_ROOT;
+	idr_init(&mpset->mc_handle_idr);
+	spin_lock_init(&mpset->stage_lock);
+	memset(mpset->stage_mc, 0, sizeof(mpset->stage_mc));
+	for (i = 0; i < MP_HOST_CACHE_CLASSES; i++)
+		INIT_LIST_HEAD(&mpset->host_cache_head[i]);
+	mpset->host_cache_size = 0;
 	return 0;
 }
 
+/**
+ * Drop the cached staging buffer pointers. The buffers themselves sit on the host
+ * allocated list and are released with the rest of the host memory.
+ */
+static void mpset_stage_drain(struct mempool_set *mpset)
+{
+	int i;
+
+	spin_lock(&mpset->stage_lock);
+	for (i = 0; i < MP_STAGE_BUF_COUNT; i++)
+		mpset->stage_mc[i] = NULL;
+	spin_unlock(&mpset->stage_lock);
+}
+
 int mpset_device_init(struct mempool_set *mpset, int num_channels, int num_regions,
 		      const phys_addr_t device_dram_addr[], const u64 device_dram_size[])
 {
@@ -210,10 +567,15 @@ static void mpset_free_host_memory(struct mempool_set *mpset)
 	struct list_head *this, *next;
 	list_for_each_safe (this, next, &mpset->host_allocated_head) {
 		struct mem_chunk *mc = list_entry(this, struct mem_chunk, host_allocated_list);
-		if (mc->va) {
-			write_lock(&mpset->rblock);
-			mc_remove_node(&mpset->root, mc);
-			write_unlock(&mpset->rblock);
+		if (mc->pages) {
+			if (mc->va)
+				mc_free_host_sg(mc);
+			else
+				mc_unpin_user_mem(mc);
+		} else if (mc->va) {
+			write_lock(&mc_host_lock);
+			mc_remove_node(&mc_host_root, mc);
+			write_unlock(&mc_host_lock);
 			if (mc->size > MEMPOOL_KMALLOC_MAX_SIZE) {
 				dma_free_coherent(mpset->pdev, mc->size, mc->va, mc->pa);
 			} else {
@@ -221,8 +583,9 @@ static void mpset_free_host_memory(struct mempool_set *mpset)
 			}
 			mc->va = NULL;
 		}
+		idr_remove(&mpset->mc_handle_idr, mc->handle);
 		list_del(&mc->host_allocated_list);
-		kfree(mc);
+		kmem_cache_free(mc_cache, mc);
 	}
 	mpset->host_mem_size = 0;
 }
@@ -231,6 +594,7 @@ void mpset_free_all(struct mempool_set *mpset)
 {
 	u32 channel, region;
 
+	mpset_stage_drain(mpset);
 	mutex_lock(&mpset->lock);
 	for (channel = 0; channel < V1_MAX_DRAM_CHANNELS; channel++) {
 		for (region = 0; region < mpset->num_regions; region++) {
@@ -238,6 +602,70 @@ void mpset_free_all(struct mempool_set *mpset)
 		}
 	}
 	mpset_free_host_memory(mpset);
+	mp_host_cache_drain(mpset);
+	mutex_unlock(&mpset->lock);
+}
+
+void mpset_free_pid(struct mempool_set *mpset, pid_t pid)
+{
+	struct list_head *this, *next;
+	u32 channel, region;
+
+	// staging buffers carry pid 0 and are skipped below, so the cached pointers
+	// in stage_mc[] (and buffers checked out by other processes) stay valid
+	mutex_lock(&mpset->lock);
+	for (channel = 0; channel < V1_MAX_DRAM_CHANNELS; channel++) {
+		for (region = 0; region < mpset->num_regions; region++) {
+			struct mempool *mp = &mpset->mp_device[channel][region];
+			if (!mp->initialized || mp->gen_pool == NULL)
+				continue;
+			mutex_lock(&mp->lock);
+			list_for_each_safe (this, next, &mp->device_allocated_head) {
+				struct mem_chunk *mc =
+					list_entry(this, struct mem_chunk, device_allocated_list);
+				if (mc->pid != pid)
+					continue;
+				// pinned by an active operation; deferred to mpset_free_all()
+				if (atomic_read(&mc->inflight))
+					continue;
+				gen_pool_free(mp->gen_pool, (unsigned long)mc->va, mc->size);
+				mp->allocated_size -= mc->size;
+				mpset->device_mem_size -= mc->size;
+				idr_remove(&mpset->mc_handle_idr, mc->handle);
+				list_del(&mc->device_allocated_list);
+				kmem_cache_free(mc_cache, mc);
+			}
+			mutex_unlock(&mp->lock);
+		}
+	}
+	list_for_each_safe (this, next, &mpset->host_allocated_head) {
+		struct mem_chunk *mc = list_entry(this, struct mem_chunk, host_allocated_list);
+		if (mc->pid != pid)
+			continue;
+		// pinned by an active operation; deferred to mpset_free_all()
+		if (atomic_read(&mc->inflight))
+			continue;
+		if (mc->pages) {
+			if (mc->va)
+				mc_free_host_sg(mc);
+			else
+				mc_unpin_user_mem(mc);
+		} else if (mc->va) {
+			write_lock(&mc_host_lock);
+			mc_remove_node(&mc_host_root, mc);
+			write_unlock(&mc_host_lock);
+			if (mc->size > MEMPOOL_KMALLOC_MAX_SIZE) {
+				dma_free_coherent(mpset->pdev, mc->size, mc->va, mc->pa);
+			} else {
+				kfree(mc->va);
+			}
+			mc->va = NULL;
+		}
+		mpset->host_mem_size -= mc->size;
+		idr_remove(&mpset->mc_handle_idr, mc->handle);
+		list_del(&mc->host_allocated_list);
+		kmem_cache_free(mc_cache, mc);
+	}
 	mutex_unlock(&mpset->lock);
 }
 
@@ -245,6 +673,7 @@ void mpset_destroy(struct mempool_set *mpset)
 {
 	u32 channel, region;
 
+	mpset_stage_drain(mpset);
 	mutex_lock(&mpset->lock);
 	for (channel = 0; channel < V1_MAX_DRAM_CHANNELS; channel++) {
 		for (region = 0; region < mpset->num_regions; region++) {
@@ -252,26 +681,53 @@ void mpset_destroy(struct mempool_set *mpset)
 		}
 	}
 	mpset_free_host_memory(mpset);
+	mp_host_cache_drain(mpset);
+	idr_destroy(&mpset->mc_handle_idr);
 	mutex_unlock(&mpset->lock);
 	memset(mpset, 0, sizeof(struct mempool_set));
 }
 
-struct mem_chunk *mpset_search_mc(struct mempool_set *mp, phys_addr_t pa)
+struct mem_chunk *mc_get_by_handle(struct mempool_set *mpset, int handle)
+{
+	struct mem_chunk *mc;
+
+	mutex_lock(&mpset->lock);
+	mc = idr_find(&mpset->mc_handle_idr, handle);
+	// pin before dropping the lock so a racing free can not take the chunk away
+	if (mc)
+		atomic_inc(&mc->inflight);
+	mutex_unlock(&mpset->lock);
+	return mc;
+}
+
+void mc_put(struct mem_chunk *mc)
+{
+	if (mc == NULL)
+		return;
+	atomic_dec(&mc->inflight);
+}
+
+bool mc_host_mem_valid(pid_t pid, phys_addr_t pa)
 {
-	struct rb_node *node = mp->root.rb_node; /* top of the tree */
+	struct rb_node *node;
+	bool valid = false;
 
+	read_lock(&mc_host_lock);
+	node = mc_host_root.rb_node; /* top of the tree */
 	while (node) {
 		struct mem_chunk *mc = rb_entry(node, struct mem_chunk, node);
 
 		if ((mc->pa <= pa) && ((mc->pa + mc->size) >= pa)) {
-			return mc;
+			valid = (mc->pid == pid);
+			break;
 		} else if (mc->pa > pa) {
 			node = node->rb_left;
 		} else {
 			node = node->rb_right;
 		}
 	}
-	return NULL;
+	read_unlock(&mc_host_lock);
+	return valid;
 }
 
 int mc_alloc(struct mempool_set *mpset, struct mem_chunk **result, u32 size,
@@ -291,22 +747,41 @@ int mc_alloc(struct mempool_set *mpset, struct mem_chunk **result, u32 size,
 	if (mpset->num_regions == 1) // shared DRAM mode, always use region 0
 		region = 0;
 
-	mc = (struct mem_chunk *)kmalloc(sizeof(struct mem_chunk), GFP_KERNEL);
+	mc = kmem_cache_zalloc(mc_cache, GFP_KERNEL);
 	if (mc == NULL)
 		return -ENOMEM;
 
 	*result = mc;
-	memset(mc, 0, sizeof(struct mem_chunk));
+	mc->pid = task_tgid_nr(current);
 
 	mutex_lock(&mpset->lock);
+	// allocate the user space handle first so failure needs no memory unwinding
+	ret = idr_alloc(&mpset->mc_handle_idr, mc, 1, 0, GFP_KERNEL);
+	if (ret < 0) {
+		mutex_unlock(&mpset->lock);
+		kmem_cache_free(mc_cache, mc);
+		*result = NULL;
+		return ret;
+	}
+	mc->handle = ret;
+	ret = 0;
 	if (location == MEM_LOC_HOST) {
 		if (size > MEMPOOL_KMALLOC_MAX_SIZE) {
-			dma_addr_t addr;
-			mc->va = dma_alloc_coherent(mpset->pdev, size, &addr,
-						    GFP_KERNEL | GFP_DMA32);
-			mc->pa = (phys_addr_t)addr;
+			// round up to the size class so the buffer can be recycled on free
+			if (mp_host_cache_class(size) >= 0)
+				size = roundup_pow_of_two(size);
+			if (!mp_host_cache_get(mpset, size, mc)) {
+				dma_addr_t addr;
+				mc->va = dma_alloc_coherent(mpset->pdev, size, &addr,
+							    GFP_KERNEL | GFP_DMA32);
+				mc->pa = (phys_addr_t)addr;
+				// fragmented hosts may not have a contiguous run this
+				// large - stitch the chunk from order-0 pages instead
+				if (mc->va == NULL)
+					mc_alloc_host_sg(mpset, mc, size);
+			}
 		} else {
-			mc->va = (void *)kmalloc(size, GFP_KERNEL);
+			mc->va = kmalloc_node(size, GFP_KERNEL, mpset->numa_node);
 			if (mc->va) {
 				memset(mc->va, 0, size);
 				mc->pa = virt_to_phys(mc->va);
@@ -315,14 +790,24 @@ int mc_alloc(struct mempool_set *mpset, struct mem_chunk **result, u32 size,
 		if (mc->va) {
 			INIT_LIST_HEAD(&mc->host_allocated_list);
 			list_add(&mc->host_allocated_list, &mpset->host_allocated_head);
-			write_lock(&mpset->rblock);
-			mc_insert_node(&mpset->root, mc);
-			write_unlock(&mpset->rblock);
+			// page backed chunks are indexed run by run already
+			if (mc->pages == NULL) {
+				write_lock(&mc_host_lock);
+				mc_insert_node(&mc_host_root, mc);
+				write_unlock(&mc_host_lock);
+			}
 		} else {
 			pr_info("host mem occupied %lld\n", mpset->host_mem_size);
 		}
+		if (mc->va)
+			mpset->host_mem_size += size;
+		mutex_unlock(&mpset->lock);
 	} else {
 		struct mempool *mp = NULL;
+
+		// device pools have their own locks, drop the mpset wide one so
+		// allocations on other channels/regions are not serialized here
+		mutex_unlock(&mpset->lock);
 		mp = &mpset->mp_device[channel][region];
 		if (!mp->gen_pool) {
 			pr_err("neuron: mempool not initialized\n");
@@ -330,18 +815,25 @@ int mc_alloc(struct mempool_set *mpset, struct mem_chunk **result, u32 size,
 			goto exit;
 		}
 
+		mutex_lock(&mp->lock);
 		mc->va = gen_pool_dma_alloc(mp->gen_pool, size, &mc->pa);
 		if (mc->va) {
 			INIT_LIST_HEAD(&mc->device_allocated_list);
 			list_add(&mc->device_allocated_list, &mp->device_allocated_head);
+			mp->allocated_size += size;
 		} else {
-			pr_info("%s total %ld occupied %ld needed %d available %ld\n", mp->name,
-				mp->region_size, mp->allocated_size, size,
-				gen_pool_avail(mp->gen_pool));
+			pr_info("%s total %ld occupied %ld needed %d available %ld largest free extent %ld\n",
+				mp->name, mp->region_size, mp->allocated_size, size,
+				gen_pool_avail(mp->gen_pool), mp_largest_free_extent(mp));
 			pr_info("device regions %d occupied %lld\n", mpset->num_regions,
 				mpset->device_mem_size);
 		}
-		mp->allocated_size += size;
+		mutex_unlock(&mp->lock);
+		if (mc->va) {
+			mutex_lock(&mpset->lock);
+			mpset->device_mem_size += size;
+			mutex_unlock(&mpset->lock);
+		}
 	}
 	if (mc->va == NULL) {
 		ret = -ENOMEM;
@@ -355,17 +847,14 @@ int mc_alloc(struct mempool_set *mpset, struct mem_chunk **result, u32 size,
 	mc->dram_region = region;
 	mc->nc_id = nc_id;
 
-	if (location == MEM_LOC_HOST)
-		mpset->host_mem_size += size;
-	else
-		mpset->device_mem_size += size;
+	return 0;
 
 exit:
+	mutex_lock(&mpset->lock);
+	idr_remove(&mpset->mc_handle_idr, mc->handle);
 	mutex_unlock(&mpset->lock);
-	if (ret) {
-		kfree(mc);
-		*result = NULL;
-	}
+	kmem_cache_free(mc_cache, mc);
+	*result = NULL;
 	return ret;
 }
 
@@ -378,34 +867,212 @@ void mc_free(struct mem_chunk **mcp)
 		return;
 
 	mpset = mc->mpset;
+
+	// device chunks only touch their pool, keep them off the mpset wide lock
+	if (mc->mem_location == MEM_LOC_DEVICE) {
+		struct mempool *mp;
+		mp = &mpset->mp_device[mc->dram_channel][mc->dram_region];
+		mutex_lock(&mp->lock);
+		list_del(&mc->device_allocated_list);
+		gen_pool_free(mp->gen_pool, (u64)mc->va, mc->size);
+		mc->va = NULL;
+		mp->allocated_size -= mc->size;
+		mutex_unlock(&mp->lock);
+
+		mutex_lock(&mpset->lock);
+		mpset->device_mem_size -= mc->size;
+		if (mc->handle) // mc_free_handle() unpublishes the handle up front
+			idr_remove(&mpset->mc_handle_idr, mc->handle);
+		mutex_unlock(&mpset->lock);
+
+		*mcp = NULL;
+		kmem_cache_free(mc_cache, mc);
+		return;
+	}
+
 	mutex_lock(&mpset->lock);
 
-	if (mc->mem_location == MEM_LOC_HOST) {
+	if (mc->pages) {
 		list_del(&mc->host_allocated_list);
-		write_lock(&mpset->rblock);
-		mc_remove_node(&mpset->root, mc);
-		write_unlock(&mpset->rblock);
+		// a kernel mapping means the pages are driver allocated, not pinned user memory
+		if (mc->va)
+			mc_free_host_sg(mc);
+		else
+			mc_unpin_user_mem(mc);
+		mpset->host_mem_size -= mc->size;
+	} else if (mc->mem_location == MEM_LOC_HOST) {
+		list_del(&mc->host_allocated_list);
+		write_lock(&mc_host_lock);
+		mc_remove_node(&mc_host_root, mc);
+		write_unlock(&mc_host_lock);
 		if (mc->size > MEMPOOL_KMALLOC_MAX_SIZE) {
-			dma_free_coherent(mpset->pdev, mc->size, mc->va, mc->pa);
+			if (!mp_host_cache_put(mpset, mc))
+				dma_free_coherent(mpset->pdev, mc->size, mc->va, mc->pa);
 		} else {
 			kfree(mc->va);
 			mc->va = NULL;
 		}
 		mpset->host_mem_size -= mc->size;
-	} else if (mc->mem_location == MEM_LOC_DEVICE) {
-		struct mempool *mp;
-		mp = &mpset->mp_device[mc->dram_channel][mc->dram_region];
-		list_del(&mc->device_allocated_list);
-		gen_pool_free(mp->gen_pool, (u64)mc->va, mc->size);
-		mc->va = NULL;
-		mp->allocated_size -= mc->size;
-		mpset->device_mem_size -= mc->size;
 	} else {
 		BUG();
 	}
 
+	if (mc->handle) // mc_free_handle() unpublishes the handle up front
+		idr_remove(&mpset->mc_handle_idr, mc->handle);
 	*mcp = NULL;
 	mutex_unlock(&mpset->lock);
 
-	kfree(mc);
+	kmem_cache_free(mc_cache, mc);
+}
+
+int mc_free_handle(struct mempool_set *mpset, int handle)
+{
+	struct mem_chunk *mc;
+
+	mutex_lock(&mpset->lock);
+	mc = idr_find(&mpset->mc_handle_idr, handle);
+	if (mc == NULL) {
+		mutex_unlock(&mpset->lock);
+		return -EINVAL;
+	}
+	if (atomic_read(&mc->inflight)) {
+		mutex_unlock(&mpset->lock);
+		return -EBUSY;
+	}
+	// unpublish the handle before freeing so no new lookup can pin the chunk
+	idr_remove(&mpset->mc_handle_idr, handle);
+	mc->handle = 0;
+	mutex_unlock(&mpset->lock);
+	mc_free(&mc);
+	return 0;
+}
+
+// cap one registration at 1GB worth of pages
+#define MC_REGISTER_MAX_PAGES (1024UL * 1024 * 1024 / PAGE_SIZE)
+
+int mc_register_user_mem(struct mempool_set *mpset, u64 va, u64 size, struct mem_chunk **result)
+{
+	struct mem_chunk *mc;
+	u64 start = va & PAGE_MASK;
+	u64 page_off = va & ~PAGE_MASK;
+	u32 nr_pages = (page_off + size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	int ret, pinned = 0;
+
+	*result = NULL;
+	if (size == 0 || nr_pages > MC_REGISTER_MAX_PAGES)
+		return -EINVAL;
+
+	mc = kmem_cache_zalloc(mc_cache, GFP_KERNEL);
+	if (mc == NULL)
+		return -ENOMEM;
+	mc->pid = task_tgid_nr(current);
+
+	mc->pages = kvmalloc(nr_pages * sizeof(struct page *), GFP_KERNEL);
+	if (mc->pages == NULL) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 2, 0)
+	pinned = get_user_pages_fast(start, nr_pages, FOLL_WRITE, mc->pages);
+#else
+	pinned = get_user_pages_fast(start, nr_pages, 1, mc->pages);
+#endif
+	if (pinned < 0) {
+		ret = pinned;
+		pinned = 0;
+		goto fail;
+	}
+	if ((u32)pinned != nr_pages) {
+		ret = -EFAULT;
+		goto fail;
+	}
+	mc->nr_pages = nr_pages;
+
+	ret = mc_index_page_runs(mpset, mc, page_off, size);
+	if (ret)
+		goto fail;
+
+	mc->pa = mc->runs[0]->pa;
+	mc->size = size;
+	mc->mpset = mpset;
+	mc->mem_location = MEM_LOC_HOST;
+
+	mutex_lock(&mpset->lock);
+	ret = idr_alloc(&mpset->mc_handle_idr, mc, 1, 0, GFP_KERNEL);
+	if (ret < 0) {
+		mutex_unlock(&mpset->lock);
+		goto fail;
+	}
+	mc->handle = ret;
+	INIT_LIST_HEAD(&mc->host_allocated_list);
+	list_add(&mc->host_allocated_list, &mpset->host_allocated_head);
+	mpset->host_mem_size += size;
+	mutex_unlock(&mpset->lock);
+
+	*result = mc;
+	return 0;
+
+fail:
+	if (mc->runs || mc->pages) {
+		mc->nr_pages = pinned;
+		mc_unpin_user_mem(mc);
+	}
+	kmem_cache_free(mc_cache, mc);
+	return ret;
+}
+
+int mc_stage_get(struct mempool_set *mpset, struct mem_chunk **result, u32 size, u32 nc_id)
+{
+	int i, ret;
+
+	*result = NULL;
+	if (size <= MP_STAGE_BUF_SIZE) {
+		spin_lock(&mpset->stage_lock);
+		for (i = 0; i < MP_STAGE_BUF_COUNT; i++) {
+			if (mpset->stage_mc[i]) {
+				*result = mpset->stage_mc[i];
+				mpset->stage_mc[i] = NULL;
+				break;
+			}
+		}
+		spin_unlock(&mpset->stage_lock);
+		if (*result)
+			return 0;
+		// allocate full staging size so the buffer can be cached on put
+		size = MP_STAGE_BUF_SIZE;
+	}
+	ret = mc_alloc(mpset, result, size, MEM_LOC_HOST, 0, 0, nc_id);
+	if (ret)
+		return ret;
+	// staging buffers are shared device infrastructure - they can be checked out
+	// by any process, so they must not be freed when their allocator exits.
+	// mpset_free_all() releases them with the rest of the host memory.
+	(*result)->pid = 0;
+	return 0;
+}
+
+void mc_stage_put(struct mem_chunk **mcp)
+{
+	struct mem_chunk *mc = *mcp;
+	struct mempool_set *mpset;
+	int i;
+
+	if (mc == NULL)
+		return;
+
+	mpset = mc->mpset;
+	if (mc->size == MP_STAGE_BUF_SIZE) {
+		spin_lock(&mpset->stage_lock);
+		for (i = 0; i < MP_STAGE_BUF_COUNT; i++) {
+			if (mpset->stage_mc[i] == NULL) {
+				mpset->stage_mc[i] = mc;
+				*mcp = NULL;
+				break;
+			}
+		}
+		spin_unlock(&mpset->stage_lock);
+		if (*mcp == NULL)
+			return;
+	}
+	mc_free(mcp);
 }
@@ -16,8 +16,11 @@
 #define NEURON_MEMPOOL_H
 
 #include <linux/types.h>
+#include <linux/atomic.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
 #include <linux/rbtree.h>
+#include <linux/idr.h>
 
 #include "v1/address_map.h"
 
@@ -36,6 +39,10 @@ struct mempool {
 	char name[32]; // friendly name
 	bool initialized; // True if initialized.
 
+	// Per pool lock so allocations in different channels/regions do not contend.
+	// Lock ordering: mpset->lock may be held when taking this, never the reverse.
+	struct mutex lock;
+
 	enum mem_location mem_location; // location of the memory
 	u32 dram_channel; // DRAM channel valid only if location is device
 	u32 dram_region; // DRAM region valid only if location is device
@@ -51,6 +58,14 @@ struct mempool {
 // DRAM region is split into multiple regions.
 #define MAX_DDR_REGIONS 4
 
+// Number of DMA staging buffers cached per device.
+#define MP_STAGE_BUF_COUNT 8
+// Size of one staging buffer - matches MAX_DMA_DESC_SIZE so one buffer backs one descriptor.
+#define MP_STAGE_BUF_SIZE (64 * 1024)
+
+// Number of size classes in the freed host buffer cache(powers of two, 512KB to 1GB).
+#define MP_HOST_CACHE_CLASSES 12
+
 struct mempool_set {
 	struct mutex lock;
 	u32 num_regions; // number of regions in the device pool
@@ -63,8 +78,14 @@ struct mempool_set {
 	u64 device_mem_size; // device memory used
 
 	void *pdev; // pci_dev->dev pointer
-	struct rb_root root; //rbtree that has all host mem chunks allocated
-	rwlock_t rblock; //protect the rbtree access
+	int numa_node; // NUMA node of the device's PCIe root port(NUMA_NO_NODE if unknown)
+	struct idr mc_handle_idr; // maps integer handles given to user space to mem chunks
+
+	spinlock_t stage_lock; // protects the staging buffer cache
+	struct mem_chunk *stage_mc[MP_STAGE_BUF_COUNT]; // cached DMA staging buffers
+
+	struct list_head host_cache_head[MP_HOST_CACHE_CLASSES]; // freed coherent host buffers by size class
+	u64 host_cache_size; // bytes currently parked in the host buffer cache
 };
 
 struct mem_chunk {
@@ -73,6 +94,9 @@ struct mem_chunk {
 	void *va; // virtual address of the chunk
 
 	u32 size; // chunk size
+	int handle; // integer handle given to user space for this chunk
+	pid_t pid; // process which allocated this chunk
+	atomic_t inflight; // operations(handle lookups, async copies) pinning this chunk
 
 	struct mempool_set *mpset; // back pointer to mpset
 
@@ -84,6 +108,15 @@ struct mem_chunk {
 
 	struct list_head device_allocated_list; // link for the allocated list in mempool
 	struct list_head host_allocated_list; // link for the allocated host list in mpset
+
+	// set when the chunk is backed by individual pages - either user memory pinned by
+	// NEURON_IOCTL_MEM_REGISTER(va is NULL) or the order-0 page fallback for large host
+	// allocations(va is the vmap() of the pages)
+	struct page **pages; // backing pages(NULL for physically contiguous chunks)
+	u32 nr_pages; // number of backing pages
+	struct mem_chunk **runs; // one child chunk per physically contiguous run
+	u32 nr_runs; // number of runs
+	u64 run_offset; // offset of this run in the registered buffer(valid on a child)
 };
 
 // List of chunks
@@ -93,6 +126,18 @@ struct mc_list {
 	struct mem_chunk *tail;
 };
 
+/**
+ * mpset_module_init() - Allocate module wide mempool resources(mem chunk slab cache).
+ *
+ * Return: 0 if initialization succeeds, a negative error code otherwise.
+ */
+int mpset_module_init(void);
+
+/**
+ * mpset_module_exit() - Release module wide mempool resources.
+ */
+void mpset_module_exit(void);
+
 /**
  * mpset_host_init() - Initialize the mpset for host memory allocation.
  *
@@ -116,12 +161,35 @@ int mpset_host_init(struct mempool_set *mpset);
 int mpset_device_init(struct mempool_set *mpset, int num_channels, int num_regions,
 		      const phys_addr_t device_dram_addr[], const u64 device_dram_size[]);
 
+/**
+ * mp_largest_free_extent() - Returns the largest contiguous free extent of a device pool.
+ *
+ * Together with gen_pool_avail() this shows how fragmented the pool is - a large
+ * available size with a small largest extent means big allocations will fail.
+ *
+ * @mp: device memory pool to scan
+ *
+ * Return: size of the largest free extent in bytes.
+ */
+size_t mp_largest_free_extent(struct mempool *mp);
+
 /** Free up all host and device memory in the mpset.
  *
  * @param mpset - Pointer to mpset
  */
 void mpset_free_all(struct mempool_set *mp);
 
+/**
+ * mpset_free_pid() - Free all host and device memory allocated by one process.
+ *
+ * Used when a process that claimed individual NeuronCores closes the device -
+ * its memory is released without touching the allocations of the other owners.
+ *
+ * @mpset: Pointer to mpset
+ * @pid: process whose allocations should be freed
+ */
+void mpset_free_pid(struct mempool_set *mpset, pid_t pid);
+
 /**
  * mpset_destroy() - Free up all memory pool in the mpset and destroys the mpset.
  *
@@ -129,14 +197,47 @@ void mpset_free_all(struct mempool_set *mp);
  */
 void mpset_destroy(struct mempool_set *mp);
 
-/** mpset_search_mc() - Find memory chunk which maps given physical address
+/** mc_get_by_handle() - Find memory chunk for given user space handle.
+ *
+ * The returned chunk is pinned - a concurrent free fails with -EBUSY until the
+ * caller releases it with mc_put().
  *
  * @mpset: Pointer to mpset
+ * @handle: handle given to user space when the chunk was allocated
+ *
+ * Return: pinned mem chunk backing the handle, NULL if the handle is invalid
+ */
+struct mem_chunk *mc_get_by_handle(struct mempool_set *mpset, int handle);
+
+/** mc_put() - Release a pin taken by mc_get_by_handle().
+ *
+ * @mc: pinned mem chunk(NULL is allowed and ignored)
+ */
+void mc_put(struct mem_chunk *mc);
+
+/** mc_free_handle() - Free the memory chunk behind a user space handle.
+ *
+ * The pin check and the handle removal happen under mpset->lock, so a chunk
+ * that passes the check can not be pinned by a new lookup afterwards.
+ *
+ * @mpset: Pointer to mpset
+ * @handle: handle given to user space when the chunk was allocated
+ *
+ * Return: 0 on success, -EINVAL for a stale handle, -EBUSY if the chunk is pinned.
+ */
+int mc_free_handle(struct mempool_set *mpset, int handle);
+
+/** mc_host_mem_valid() - Check a physical address is host memory allocated by given process.
+ *
+ * All host allocations are indexed in one interval tree regardless of the device they
+ * were allocated through, so this is a single lookup.
+ *
+ * @pid: process which should own the memory
  * @pa: physical address to search
  *
- * Return: mem chunk that has pa on success, NULL on failure
+ * Return: true if pa falls inside a host chunk allocated by pid
  */
-struct mem_chunk *mpset_search_mc(struct mempool_set *mp, phys_addr_t pa);
+bool mc_host_mem_valid(pid_t pid, phys_addr_t pa);
 
 /**
  * mc_alloc() - Allocate a memory chunk of size from given mpset.
@@ -160,4 +261,45 @@ int mc_alloc(struct mempool_set *mpset, struct mem_chunk **result, u32 size,
  */
 void mc_free(struct mem_chunk **mcp);
 
+/**
+ * mc_register_user_mem() - Pin user memory and wrap it in a mem chunk for zero-copy DMA.
+ *
+ * The pages are pinned and merged into physically contiguous runs; each run is indexed
+ * in the host interval tree so DMA descriptor validation accepts the memory. The
+ * resulting chunk can be used in NEURON_IOCTL_MEM_COPY and is freed with mc_free(),
+ * which unpins the pages.
+ *
+ * @mpset: mpset which should track the registration
+ * @va: user virtual address of the buffer(need not be page aligned)
+ * @size: buffer size in bytes
+ * @result: Buffer to store the memory chunk pointer
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int mc_register_user_mem(struct mempool_set *mpset, u64 va, u64 size, struct mem_chunk **result);
+
+/**
+ * mc_stage_get() - Get a host DMA staging buffer, from the cache when possible.
+ *
+ * Requests up to MP_STAGE_BUF_SIZE are served from a small per device cache to avoid
+ * an alloc/free cycle on every ioctl; larger requests fall back to mc_alloc().
+ *
+ * @mpset: mpset from which the buffer should be taken
+ * @result: Buffer to store the memory chunk pointer
+ * @size: Required size
+ * @nc_id: neuron core index(used only when a new chunk needs to be allocated)
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int mc_stage_get(struct mempool_set *mpset, struct mem_chunk **result, u32 size, u32 nc_id);
+
+/**
+ * mc_stage_put() - Return a staging buffer taken with mc_stage_get().
+ *
+ * The buffer is parked in the cache when there is room, freed otherwise.
+ *
+ * @mcp: Pointer to the memory chunk(set to NULL on return)
+ */
+void mc_stage_put(struct mem_chunk **mcp);
+
 #endif
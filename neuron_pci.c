@@ -17,6 +17,7 @@
 #include "v1/address_map.h"
 
 #include "neuron_dma.h"
+#include "neuron_stats.h"
 
 /* Vendor / Device ID for all devices supported by the driver */
 #define INF_VENDOR_ID 0x1D0F
@@ -46,6 +47,9 @@ static struct pci_device_id neuron_pci_dev_ids[] = {
 // number of devices managed
 static atomic_t device_count = ATOMIC_INIT(0);
 
+// unbound so that bring-up of multiple devices runs concurrently
+static struct workqueue_struct *neuron_init_wq;
+
 extern int ncdev_create_device_node(struct neuron_device *ndev);
 extern int ncdev_delete_device_node(struct neuron_device *ndev);
 extern void ndmar_preinit(struct neuron_device *nd);
@@ -64,15 +68,20 @@ static int neuron_pci_device_init(struct neuron_device *nd)
 
 	ndmar_preinit(nd);
 
+	ret = ndma_stats_init(nd);
+	if (ret)
+		goto fail_stats;
+
 	// Initialize the device mpset
 	memset(&nd->mpset, 0, sizeof(struct mempool_set));
+	nd->mpset.pdev = &(nd->pdev->dev);
 
 	// Initialize the host portion in mpset
 	ret = mpset_host_init(&nd->mpset);
 	if (ret)
 		goto fail_mpset;
 
-	nd->mpset.pdev = &(nd->pdev->dev);
+	nc_nq_watch_init(nd);
 
 	pci_read_config_byte(nd->pdev, PCI_REVISION_ID, &nd->revision);
 	// Initialize the arch type to Inferentia
@@ -82,11 +91,14 @@ static int neuron_pci_device_init(struct neuron_device *nd)
 		pci_info(nd->pdev, "create device node failed\n");
 		goto fail_chardev;
 	}
+	neuron_stats_debugfs_init(nd);
 	return 0;
 
 fail_chardev:
 	mpset_destroy(&nd->mpset);
 fail_mpset:
+	ndma_stats_destroy(nd);
+fail_stats:
 	fw_io_destroy((struct fw_io_ctx *)nd->fw_io_ctx);
 	nd->fw_io_ctx = NULL;
 	return ret;
@@ -101,7 +113,10 @@ int neuron_pci_device_close(struct neuron_device *nd)
 		pci_info(nd->pdev, "delete device node failed\n");
 		return ret;
 	}
+	neuron_stats_debugfs_destroy(nd);
+	nc_nq_watch_stop(nd);
 	mpset_destroy(&nd->mpset);
+	ndma_stats_destroy(nd);
 	fw_io_destroy((struct fw_io_ctx *)nd->fw_io_ctx);
 	nd->fw_io_ctx = NULL;
 	return 0;
@@ -109,6 +124,26 @@ int neuron_pci_device_close(struct neuron_device *nd)
 
 static struct neuron_device *neuron_devices[MAX_NEURON_DEVICE_COUNT] = { 0 };
 
+/* Runs the slow part of probe (firmware mailbox setup, memory pools, device node
+ * creation) so that devices initialize in parallel instead of serializing in probe.
+ * The device becomes visible through neuron_pci_get_device() only on success.
+ */
+static void neuron_pci_device_init_work(struct work_struct *work)
+{
+	struct neuron_device *nd = container_of(work, struct neuron_device, init_work);
+	int ret;
+
+	ret = neuron_pci_device_init(nd);
+	if (ret) {
+		pci_info(nd->pdev, "device init failed %d\n", ret);
+		nd->init_ret = ret;
+		return;
+	}
+
+	BUG_ON(neuron_devices[nd->device_index] != NULL);
+	neuron_devices[nd->device_index] = nd;
+}
+
 struct neuron_device *neuron_pci_get_device(u8 device_index)
 {
 	BUG_ON(device_index >= MAX_NEURON_DEVICE_COUNT);
@@ -171,19 +206,23 @@ static int neuron_pci_probe(struct pci_dev *dev, const struct pci_device_id *id)
 	}
 	nd->npdev.bar2 = pci_iomap(dev, INF_AXI_BAR, pci_resource_len(dev, INF_AXI_BAR));
 	nd->npdev.bar2_size = pci_resource_len(dev, INF_AXI_BAR);
+
+	/* interrupts are optional - DMA completion falls back to polling without them */
+	nd->num_irqs = pci_alloc_irq_vectors(dev, 1, NUM_DMA_ENG_PER_DEVICE, PCI_IRQ_MSIX);
+	if (nd->num_irqs < 0) {
+		pci_info(dev, "MSI-X not available, DMA completion will be polled\n");
+		nd->num_irqs = 0;
+	}
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
 	nd->device_index = atomic_fetch_add(1, &device_count);
 #else
 	nd->device_index = atomic_add_return(1, &device_count) - 1;
 #endif
 
-	ret = neuron_pci_device_init(nd);
-	if (ret) {
-		goto fail_bar2_resource;
-	}
-
-	BUG_ON(neuron_devices[nd->device_index] != NULL);
-	neuron_devices[nd->device_index] = nd;
+	// bring-up waits on device firmware - hand it to the workqueue so a
+	// multi-device system does not pay the wait once per device
+	INIT_WORK(&nd->init_work, neuron_pci_device_init_work);
+	queue_work(neuron_init_wq, &nd->init_work);
 
 	return 0;
 
@@ -208,11 +247,17 @@ static void neuron_pci_remove(struct pci_dev *dev)
 	if (nd == NULL)
 		return;
 
+	flush_work(&nd->init_work);
+
+	ndmar_irq_free(nd);
+	if (nd->num_irqs)
+		pci_free_irq_vectors(dev);
 	pci_release_region(dev, INF_AXI_BAR);
 	pci_release_region(dev, INF_APB_BAR);
 	pci_disable_device(dev);
 
-	neuron_pci_device_close(nd);
+	if (nd->init_ret == 0)
+		neuron_pci_device_close(nd);
 
 	neuron_devices[nd->device_index] = NULL;
 
@@ -230,9 +275,16 @@ int neuron_pci_module_init(void)
 {
 	int ret;
 
+	neuron_init_wq = alloc_workqueue("neuron_init", WQ_UNBOUND, 0);
+	if (neuron_init_wq == NULL) {
+		pr_err("Failed to create neuron init workqueue\n");
+		return -ENOMEM;
+	}
+
 	ret = pci_register_driver(&neuron_pci_driver);
 	if (ret != 0) {
 		pr_err("Failed to register neuron driver %d\n", ret);
+		destroy_workqueue(neuron_init_wq);
 		return ret;
 	}
 
@@ -241,5 +293,7 @@ int neuron_pci_module_init(void)
 
 void neuron_pci_module_exit(void)
 {
+	// unregister runs remove() for every device, which flushes its init work
 	pci_unregister_driver(&neuron_pci_driver);
+	destroy_workqueue(neuron_init_wq);
 }
@@ -7,6 +7,9 @@
 
 #include <linux/string.h>
 #include <linux/types.h>
+#include <linux/interrupt.h>
+#include <linux/module.h>
+#include <linux/pci.h>
 
 #include "udma/udma.h"
 #include "v1/address_map.h"
@@ -16,6 +19,16 @@
 #include "neuron_dma.h"
 #include "neuron_mempool.h"
 
+int h2t_ring_count = 2;
+module_param(h2t_ring_count, int, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(h2t_ring_count,
+		 "Number of H2T DMA rings per engine(1-4). Applied when a device is initialized");
+
+int h2t_desc_count = DMA_H2T_DESC_COUNT;
+module_param(h2t_desc_count, int, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(h2t_desc_count,
+		 "Number of descriptors in each H2T DMA ring. Applied when a device is initialized");
+
 static struct ndma_eng *ndmar_acquire_engine(struct neuron_device *nd, u32 eng_id)
 {
 	if (eng_id >= NUM_DMA_ENG_PER_DEVICE)
@@ -125,6 +138,12 @@ int ndmar_queue_init(struct neuron_device *nd, u32 eng_id, u32 qid, u32 tx_desc_
 	if (eng == NULL)
 		return -EINVAL;
 
+	// the top queues of an H2T engine belong to the driver's H2T rings
+	if (eng->used_for_h2t && qid > MAX_DMA_RINGS - 1 - eng->h2t_ring_count) {
+		ndmar_release_engine(eng);
+		return -EINVAL;
+	}
+
 	queue = ndmar_get_queue(eng, qid);
 	ring = ndmar_get_ring(queue);
 
@@ -189,6 +208,34 @@ int ndmar_queue_copy_start(struct neuron_device *nd, u32 eng_id, u32 qid, u32 tx
 	return ret;
 }
 
+int ndmar_queue_replay(struct neuron_device *nd, u32 eng_id, u32 qid, u32 tx_desc_count,
+		       u32 rx_desc_count)
+{
+	int ret;
+	struct ndma_eng *eng;
+	struct udma_q *txq, *rxq;
+
+	eng = ndmar_acquire_engine(nd, eng_id);
+	if (eng == NULL)
+		return -EINVAL;
+
+	trace_dma_queue_copy_start(nd, eng_id, qid, tx_desc_count, rx_desc_count);
+
+	udma_q_handle_get(&eng->udma, qid, UDMA_TX, &txq);
+	udma_q_handle_get(&eng->udma, qid, UDMA_RX, &rxq);
+	ret = udma_q_rewind(txq);
+	if (ret == 0)
+		ret = udma_q_rewind(rxq);
+	if (ret == 0)
+		ret = udma_m2m_copy_start(&eng->udma, qid, tx_desc_count, rx_desc_count);
+	if (ret)
+		pr_err("queue replay failed on %s q%d - %d\n", eng->udma.name, qid, ret);
+
+	ndmar_release_engine(eng);
+
+	return ret;
+}
+
 int ndmar_queue_release(struct neuron_device *nd, u32 eng_id, u32 qid)
 {
 	trace_dma_queue_release(nd, eng_id, qid);
@@ -203,40 +250,60 @@ int ndmar_h2t_ring_alloc(struct neuron_device *nd, int nc_id)
 	struct ndma_queue *queue;
 	struct ndma_ring *ring;
 	int eng_id = DMA_ENG_IDX_H2T + (nc_id * V1_DMA_ENG_PER_NC);
-	int ndesc = DMA_H2T_DESC_COUNT;
-	u32 ring_size = ndmar_ring_get_desc_count(ndesc) * sizeof(union udma_desc);
-	int qid = MAX_DMA_RINGS - 1;
-	struct mem_chunk *rx_mc = NULL, *tx_mc = NULL;
+	int ndesc = h2t_desc_count;
+	u32 ring_size;
+	u32 ring_count = h2t_ring_count;
+	int rid, qid;
+	struct mem_chunk *rx_mc, *tx_mc;
+
+	if (ring_count < 1)
+		ring_count = 1;
+	if (ring_count > MAX_H2T_RINGS)
+		ring_count = MAX_H2T_RINGS;
+	if (ndesc < 64)
+		ndesc = 64;
+	if (ndesc > DMA_H2T_DESC_COUNT_MAX)
+		ndesc = DMA_H2T_DESC_COUNT_MAX;
+	ring_size = ndmar_ring_get_desc_count(ndesc) * sizeof(union udma_desc);
 
 	eng = ndmar_acquire_engine(nd, eng_id);
 	if (eng == NULL)
 		return -EINVAL;
 
 	eng->used_for_h2t = true;
-	queue = &eng->queues[MAX_DMA_RINGS - 1];
-	queue->qid = qid;
-	queue->eng_id = eng_id;
-	ring = &queue->ring_info;
-	ring->qid = qid;
-	ring->size = ring_size;
-	ring->has_compl = false;
-
-	ret = mc_alloc(&nd->mpset, &rx_mc, ring_size, MEM_LOC_HOST, 0, 0, nc_id);
-	if (ret) {
-		pr_err("can't allocate rx queue for H2T - size %d\n", ring_size);
-		goto error;
-	}
+	eng->h2t_ring_count = ring_count;
+	atomic_set(&eng->h2t_ring_rr, 0);
+
+	for (rid = 0; rid < ring_count; rid++) {
+		qid = MAX_DMA_RINGS - 1 - rid;
+		rx_mc = NULL;
+		tx_mc = NULL;
+		queue = &eng->queues[qid];
+		queue->qid = qid;
+		queue->eng_id = eng_id;
+		ring = &queue->ring_info;
+		ring->qid = qid;
+		ring->size = ring_size;
+		ring->ndesc = ndesc;
+		ring->has_compl = false;
+
+		ret = mc_alloc(&nd->mpset, &rx_mc, ring_size, MEM_LOC_HOST, 0, 0, nc_id);
+		if (ret) {
+			pr_err("can't allocate rx queue for H2T - size %d\n", ring_size);
+			goto error;
+		}
 
-	ret = mc_alloc(&nd->mpset, &tx_mc, ring_size, MEM_LOC_HOST, 0, 0, nc_id);
-	if (ret) {
-		pr_err("can't allocate tx queue for H2T - size %d\n", ring_size);
-		goto error;
-	}
+		ret = mc_alloc(&nd->mpset, &tx_mc, ring_size, MEM_LOC_HOST, 0, 0, nc_id);
+		if (ret) {
+			pr_err("can't allocate tx queue for H2T - size %d\n", ring_size);
+			goto error;
+		}
 
-	ndmar_ring_set_mem_chunk(eng, qid, tx_mc, 0, NEURON_DMA_QUEUE_TYPE_TX);
-	ndmar_ring_set_mem_chunk(eng, qid, rx_mc, 0, NEURON_DMA_QUEUE_TYPE_RX);
+		ndmar_ring_set_mem_chunk(eng, qid, tx_mc, 0, NEURON_DMA_QUEUE_TYPE_TX);
+		ndmar_ring_set_mem_chunk(eng, qid, rx_mc, 0, NEURON_DMA_QUEUE_TYPE_RX);
 
-	mutex_init(&eng->h2t_ring_lock);
+		mutex_init(&eng->h2t_ring_lock[rid]);
+	}
 
 	ndmar_release_engine(eng);
 
@@ -258,14 +325,19 @@ static int ndmar_h2t_ring_init(struct ndma_eng *eng)
 	int ret = -1;
 	struct ndma_queue *queue;
 	struct ndma_ring *ring;
-	int qid = MAX_DMA_RINGS - 1;
-	int ndesc = DMA_H2T_DESC_COUNT;
-	u32 alloced_desc = ndmar_ring_get_desc_count(ndesc);
-
-	queue = &eng->queues[MAX_DMA_RINGS - 1];
-	ring = &queue->ring_info;
-	ret = udma_m2m_init_queue(&eng->udma, qid, alloced_desc, alloced_desc, true, &ring->tx,
-				  &ring->rx, NULL);
+	int rid, qid;
+	u32 alloced_desc;
+
+	for (rid = 0; rid < eng->h2t_ring_count; rid++) {
+		qid = MAX_DMA_RINGS - 1 - rid;
+		queue = &eng->queues[qid];
+		ring = &queue->ring_info;
+		alloced_desc = ndmar_ring_get_desc_count(ring->ndesc);
+		ret = udma_m2m_init_queue(&eng->udma, qid, alloced_desc, alloced_desc, true,
+					  &ring->tx, &ring->rx, NULL);
+		if (ret)
+			return ret;
+	}
 	return ret;
 }
 
@@ -312,6 +384,9 @@ int ndmar_queue_get_descriptor_mc(struct neuron_device *nd, u8 eng_id, u8 qid,
 	struct ndma_queue *q;
 	struct udma *udma;
 
+	if (qid >= MAX_DMA_RINGS)
+		return -EINVAL;
+
 	eng = ndmar_acquire_engine(nd, eng_id);
 	if (eng == NULL)
 		return -EINVAL;
@@ -370,8 +445,24 @@ int ndmar_eng_init(struct neuron_device *nd, int eng_id)
 	if (eng->used_for_h2t) {
 		// Reinitialize the h2t queue
 		ret = ndmar_h2t_ring_init(eng);
-		if (ret)
+		if (ret) {
 			pr_err("could not reinitialize the h2t queue\n");
+			goto done;
+		}
+		// Wire up MSI-X so H2T completion can sleep instead of polling.
+		// If no vector is available the H2T path falls back to polling.
+		if (eng->irq < 0 && eng_id < nd->num_irqs) {
+			int irq = pci_irq_vector(nd->pdev, eng_id);
+			snprintf(eng->irq_name, sizeof(eng->irq_name), "neuron%d-dma%d",
+				 nd->device_index, eng_id);
+			if (request_irq(irq, ndma_h2t_irq_handler, 0, eng->irq_name, eng)) {
+				pr_info("ENG:%d no MSI-X vector, using polled DMA completion\n",
+					eng_id);
+			} else {
+				udma_iofic_completion_config(&eng->udma, MAX_DMA_RINGS - 1);
+				eng->irq = irq;
+			}
+		}
 	}
 done:
 	ndmar_release_engine(eng);
@@ -387,10 +478,26 @@ void ndmar_preinit(struct neuron_device *nd)
 		eng = &nd->ndma_engine[i];
 		eng->nd = nd;
 		eng->eng_id = i;
+		eng->irq = -1;
+		init_completion(&eng->h2t_done);
 		mutex_init(&eng->lock);
 	}
 }
 
+void ndmar_irq_free(struct neuron_device *nd)
+{
+	int i;
+	struct ndma_eng *eng;
+
+	for (i = 0; i < NUM_DMA_ENG_PER_DEVICE; i++) {
+		eng = &nd->ndma_engine[i];
+		if (eng->irq < 0)
+			continue;
+		free_irq(eng->irq, eng);
+		eng->irq = -1;
+	}
+}
+
 int ndmar_init(struct neuron_device *nd)
 {
 	int ret = 0;
@@ -431,21 +538,24 @@ static void ndmar_h2t_ring_free(struct neuron_device *nd, int eng_id)
 	struct ndma_eng *eng;
 	struct ndma_queue *queue;
 	struct ndma_ring *ring;
+	int rid;
 
 	eng = ndmar_acquire_engine(nd, eng_id);
 	BUG_ON(eng == NULL);
 
-	queue = &eng->queues[MAX_DMA_RINGS - 1];
-	ring = &queue->ring_info;
+	for (rid = 0; rid < eng->h2t_ring_count; rid++) {
+		queue = &eng->queues[MAX_DMA_RINGS - 1 - rid];
+		ring = &queue->ring_info;
 
-	if (ring->tx_mc)
-		mc_free(&ring->tx_mc);
+		if (ring->tx_mc)
+			mc_free(&ring->tx_mc);
 
-	if (ring->rx_mc)
-		mc_free(&ring->rx_mc);
+		if (ring->rx_mc)
+			mc_free(&ring->rx_mc);
 
-	if (ring->rxc_mc)
-		mc_free(&ring->rxc_mc);
+		if (ring->rxc_mc)
+			mc_free(&ring->rxc_mc);
+	}
 
 	ndmar_release_engine(eng);
 }
@@ -453,6 +563,7 @@ static void ndmar_h2t_ring_free(struct neuron_device *nd, int eng_id)
 void ndmar_close(struct neuron_device *nd)
 {
 	int nc_id;
+	ndmar_irq_free(nd);
 	for (nc_id = 0; nc_id < V1_NC_PER_DEVICE; nc_id++) {
 		ndmar_h2t_ring_free(nd, DMA_ENG_IDX_H2T + (nc_id * V1_DMA_ENG_PER_NC));
 	}
@@ -6,23 +6,35 @@
 #ifndef NEURON_RING_H
 #define NEURON_RING_H
 
+#include <linux/atomic.h>
+#include <linux/completion.h>
+
 #include "udma/udma.h"
 #include "v1/tdma.h"
 #include "v1/address_map.h"
 
 #define DMA_ENG_IDX_H2T 2
 #define DMA_H2T_DESC_COUNT 4096
+// upper limit on the h2t_desc_count module param; each descriptor needs
+// contiguous host memory, so an unbounded count would fail (or exhaust)
+// the coherent allocation done at device probe.
+#define DMA_H2T_DESC_COUNT_MAX (64 * 1024)
 #define MAX_DMA_RINGS 16
+// upper limit of H2T rings per engine; the actual count comes from the
+// h2t_ring_count module param. H2T ring i occupies queue MAX_DMA_RINGS - 1 - i.
+#define MAX_H2T_RINGS 4
 
 #define NUM_DMA_ENG_PER_DEVICE (V1_NC_PER_DEVICE * V1_DMA_ENG_PER_NC)
 
 struct neuron_device;
 struct neuron_dma_eng_state;
 struct neuron_dma_queue_state;
+struct ndma_eng_stats;
 
 struct ndma_ring {
 	u32 qid;
 	u32 size; //total size - num desc * desc size
+	u32 ndesc; // number of usable descriptors requested for the ring
 	bool has_compl;
 	struct udma_ring_ptr tx;
 	struct udma_ring_ptr rx;
@@ -47,7 +59,15 @@ struct ndma_eng {
 	struct ndma_queue queues[DMA_MAX_Q_MAX];
 	struct udma udma;
 	bool used_for_h2t;
-	struct mutex h2t_ring_lock;
+	u32 h2t_ring_count; // number of H2T rings allocated on this engine
+	struct mutex h2t_ring_lock[MAX_H2T_RINGS]; // one per H2T ring
+	atomic_t h2t_ring_rr; // round robin cursor for H2T ring selection
+
+	struct ndma_eng_stats __percpu *stats; // always-on transfer counters(see neuron_stats.h)
+
+	int irq; // MSI-X vector used for H2T completion(-1 if interrupts are not available)
+	char irq_name[32]; // friendly name shown in /proc/interrupts
+	struct completion h2t_done; // signaled by the interrupt handler when completion marker lands
 };
 
 /**
@@ -108,6 +128,24 @@ int ndmar_queue_init(struct neuron_device *nd, u32 eng_id, u32 qid, u32 tx_desc_
 		     u32 rx_desc_count, struct mem_chunk *tx_mc, struct mem_chunk *rx_mc,
 		     struct mem_chunk *rxc_mc, u32 port);
 
+/**
+ * ndmar_queue_replay() - Re-execute descriptors already loaded in a DMA queue.
+ *
+ * Rewinds the queue's ring pointers to the base and rings the doorbell, so a
+ * descriptor program loaded earlier runs again without copying or validating
+ * the descriptors. The queue must not have a completion ring configured.
+ *
+ * @nd: Neuron device which contains the DMA engine
+ * @eng_id: DMA engine index which contains the DMA queue
+ * @qid: DMA queue index
+ * @tx_desc_count: Number of Tx descriptors to transfer
+ * @rx_desc_count: Number of Rx descriptors to transfer
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int ndmar_queue_replay(struct neuron_device *nd, u32 eng_id, u32 qid, u32 tx_desc_count,
+		       u32 rx_desc_count);
+
 /**
  * ndmar_queue_release() - Release a DMA queue.
  *
@@ -176,6 +214,13 @@ int ndmar_queue_get_descriptor_mc(struct neuron_device *nd, u8 eng_id, u8 qid,
  */
 int ndmar_eng_get_state(struct neuron_device *nd, int eng_id, struct neuron_dma_eng_state *state);
 
+/**
+ * ndmar_irq_free() - Release MSI-X vectors requested for DMA engines.
+ *
+ * @nd: Neuron device whose DMA interrupt vectors need to be released
+ */
+void ndmar_irq_free(struct neuron_device *nd);
+
 /**
  * ndmar_queue_get_state() - Get current state of the Tx and Rx queue.
  *
@@ -190,4 +235,21 @@ int ndmar_eng_get_state(struct neuron_device *nd, int eng_id, struct neuron_dma_
 int ndmar_queue_get_state(struct neuron_device *nd, int eng_id, int qid,
 			  struct neuron_dma_queue_state *tx, struct neuron_dma_queue_state *rx);
 
+/**
+ * ndmar_eng_get_snapshot() - Get the state of every queue in a DMA engine in one pass.
+ *
+ * @nd: Neuron device which contains the DMA engine
+ * @eng_id: DMA engine index
+ * @sw_only: if true, fill from the driver's ring pointer shadows without reading hardware
+ * @max_queues: capacity of the tx and rx arrays(in queue states)
+ * @tx: TxQueue states will be set here, one per queue
+ * @rx: RxQueue states will be set here, one per queue
+ * @num_queues: number of queue pairs captured will be set here
+ *
+ * Return: 0 on success, a negative error code otherwise
+ */
+int ndmar_eng_get_snapshot(struct neuron_device *nd, int eng_id, bool sw_only, u32 max_queues,
+			   struct neuron_dma_queue_state *tx, struct neuron_dma_queue_state *rx,
+			   u32 *num_queues);
+
 #endif
@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright 2020, Amazon.com, Inc. or its affiliates. All Rights Reserved
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/genalloc.h>
+
+#include "neuron_device.h"
+#include "neuron_stats.h"
+
+int ndma_stats_init(struct neuron_device *nd)
+{
+	int i;
+
+	for (i = 0; i < NUM_DMA_ENG_PER_DEVICE; i++) {
+		nd->ndma_engine[i].stats = alloc_percpu(struct ndma_eng_stats);
+		if (nd->ndma_engine[i].stats == NULL) {
+			ndma_stats_destroy(nd);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+void ndma_stats_destroy(struct neuron_device *nd)
+{
+	int i;
+
+	for (i = 0; i < NUM_DMA_ENG_PER_DEVICE; i++) {
+		free_percpu(nd->ndma_engine[i].stats);
+		nd->ndma_engine[i].stats = NULL;
+	}
+}
+
+/* Sums the percpu counters of an engine. The counters are updated without locking,
+ * so the result is only a consistent snapshot when the engine is idle - good enough
+ * for statistics.
+ */
+static void ndma_stats_sum(struct ndma_eng *eng, struct ndma_eng_stats *sum)
+{
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		struct ndma_eng_stats *stats = per_cpu_ptr(eng->stats, cpu);
+		sum->bytes += stats->bytes;
+		sum->descs += stats->descs;
+		sum->waits += stats->waits;
+		sum->wait_usecs += stats->wait_usecs;
+		for (i = 0; i < NDMA_STATS_LAT_BUCKETS; i++)
+			sum->lat_hist[i] += stats->lat_hist[i];
+	}
+}
+
+static int ndma_stats_show(struct seq_file *s, void *v)
+{
+	struct neuron_device *nd = s->private;
+	struct ndma_eng_stats sum;
+	int i, bucket;
+
+	for (i = 0; i < NUM_DMA_ENG_PER_DEVICE; i++) {
+		struct ndma_eng *eng = &nd->ndma_engine[i];
+		if (eng->stats == NULL)
+			continue;
+		ndma_stats_sum(eng, &sum);
+		if (sum.descs == 0 && sum.waits == 0)
+			continue;
+		seq_printf(s, "eng%02d bytes %llu descs %llu waits %llu wait_usecs %llu\n", i,
+			   sum.bytes, sum.descs, sum.waits, sum.wait_usecs);
+		seq_printf(s, "eng%02d wait_hist", i);
+		for (bucket = 0; bucket < NDMA_STATS_LAT_BUCKETS; bucket++) {
+			if (sum.lat_hist[bucket] == 0)
+				continue;
+			seq_printf(s, " <%lluus:%llu", 1ULL << bucket, sum.lat_hist[bucket]);
+		}
+		seq_putc(s, '\n');
+	}
+	return 0;
+}
+
+static int ndma_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ndma_stats_show, inode->i_private);
+}
+
+static const struct file_operations ndma_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = ndma_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int nmem_stats_show(struct seq_file *s, void *v)
+{
+	struct neuron_device *nd = s->private;
+	struct mempool_set *mpset = &nd->mpset;
+	u32 channel, region;
+
+	seq_printf(s, "host_mem_size %llu\n", mpset->host_mem_size);
+	seq_printf(s, "device_mem_size %llu\n", mpset->device_mem_size);
+	for (channel = 0; channel < V1_MAX_DRAM_CHANNELS; channel++) {
+		for (region = 0; region < mpset->num_regions; region++) {
+			struct mempool *mp = &mpset->mp_device[channel][region];
+			if (!mp->initialized)
+				continue;
+			seq_printf(s, "%s size %zu allocated %zu avail %zu largest_free %zu\n",
+				   mp->name, mp->region_size, mp->allocated_size,
+				   gen_pool_avail(mp->gen_pool), mp_largest_free_extent(mp));
+		}
+	}
+	return 0;
+}
+
+static int nmem_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nmem_stats_show, inode->i_private);
+}
+
+static const struct file_operations nmem_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = nmem_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+void neuron_stats_debugfs_init(struct neuron_device *nd)
+{
+	char name[32];
+
+	if (neuron_debugfs_root() == NULL)
+		return;
+	snprintf(name, sizeof(name), "device%d", nd->device_index);
+	nd->dbgfs_dir = debugfs_create_dir(name, neuron_debugfs_root());
+	debugfs_create_file("dma_stats", S_IRUSR | S_IRGRP, nd->dbgfs_dir, nd, &ndma_stats_fops);
+	debugfs_create_file("mem_stats", S_IRUSR | S_IRGRP, nd->dbgfs_dir, nd, &nmem_stats_fops);
+}
+
+void neuron_stats_debugfs_destroy(struct neuron_device *nd)
+{
+	debugfs_remove_recursive(nd->dbgfs_dir);
+	nd->dbgfs_dir = NULL;
+}
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright 2020, Amazon.com, Inc. or its affiliates. All Rights Reserved
+ */
+
+/* Always-on per-engine DMA statistics. Updates are percpu and lock free, cheap
+ * enough to stay enabled in production unlike the ftrace events, and are read
+ * through debugfs(neuron/device<N>/dma_stats).
+ */
+
+#ifndef NEURON_STATS_H
+#define NEURON_STATS_H
+
+#include <linux/percpu.h>
+#include <linux/log2.h>
+
+#include "neuron_ring.h"
+
+struct neuron_device;
+struct dentry;
+
+// log2 buckets for completion wait latency - bucket i counts waits shorter
+// than 2^i usec(bucket 0 is sub-usec), the last bucket collects everything above.
+#define NDMA_STATS_LAT_BUCKETS 26
+
+struct ndma_eng_stats {
+	u64 bytes; // bytes moved through the engine
+	u64 descs; // data descriptors submitted
+	u64 waits; // completion waits
+	u64 wait_usecs; // total time spent waiting for completions
+	u64 lat_hist[NDMA_STATS_LAT_BUCKETS]; // log2 histogram of wait latency
+};
+
+/**
+ * ndma_stats_xfer() - Account a submitted data descriptor.
+ *
+ * @eng: engine the descriptor was queued on
+ * @bytes: transfer size of the descriptor
+ */
+static inline void ndma_stats_xfer(struct ndma_eng *eng, u32 bytes)
+{
+	if (eng->stats == NULL)
+		return;
+	this_cpu_add(eng->stats->bytes, bytes);
+	this_cpu_inc(eng->stats->descs);
+}
+
+/**
+ * ndma_stats_wait() - Account a completion wait.
+ *
+ * @eng: engine that was waited on
+ * @usecs: how long the wait took
+ */
+static inline void ndma_stats_wait(struct ndma_eng *eng, u64 usecs)
+{
+	u32 bucket = usecs ? min_t(u32, fls64(usecs), NDMA_STATS_LAT_BUCKETS - 1) : 0;
+
+	if (eng->stats == NULL)
+		return;
+	this_cpu_inc(eng->stats->waits);
+	this_cpu_add(eng->stats->wait_usecs, usecs);
+	this_cpu_inc(eng->stats->lat_hist[bucket]);
+}
+
+/**
+ * ndma_stats_init() - Allocate percpu statistics for every DMA engine of the device.
+ *
+ * @nd: Neuron device
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int ndma_stats_init(struct neuron_device *nd);
+
+/**
+ * ndma_stats_destroy() - Free the percpu statistics of the device.
+ *
+ * @nd: Neuron device
+ */
+void ndma_stats_destroy(struct neuron_device *nd);
+
+/**
+ * neuron_stats_debugfs_init() - Create the device's debugfs directory and stats files.
+ *
+ * @nd: Neuron device
+ */
+void neuron_stats_debugfs_init(struct neuron_device *nd);
+
+/**
+ * neuron_stats_debugfs_destroy() - Remove the device's debugfs directory.
+ *
+ * @nd: Neuron device
+ */
+void neuron_stats_debugfs_destroy(struct neuron_device *nd);
+
+/**
+ * neuron_debugfs_root() - Returns the module's debugfs directory.
+ *
+ * Return: NULL if debugfs is not available.
+ */
+struct dentry *neuron_debugfs_root(void);
+
+#endif
@@ -235,6 +235,19 @@ int udma_q_init(struct udma *udma, u32 qid, struct udma_q_params *q_params);
  */
 int udma_q_reset(struct udma_q *udma_q);
 
+/**
+ * udma_q_rewind() - Rewind a queue to its base so its descriptors can be executed again.
+ *
+ * Resets the software indices and the hardware ring pointers without touching the
+ * descriptor ring contents. The same restrictions as for 'udma_q_reset' apply and
+ * the queue must not have a completion ring configured.
+ *
+ * @udma_q:	udma queue data structure
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int udma_q_rewind(struct udma_q *udma_q);
+
 /**
  * udma_q_handle_get() -  Return a pointer to a queue date structure.
  *
@@ -260,6 +273,25 @@ void udma_iofic_m2s_error_ints_unmask(struct udma *udma);
  */
 void udma_iofic_s2m_error_ints_unmask(struct udma *udma);
 
+/**
+ * udma_iofic_completion_config() - Enable MSI-X generation for RX completions of given queue.
+ *
+ * Descriptors queued with the interrupt enable bit(S2M_DESC_INT_EN) would generate MSI-X
+ * once the data is written to the destination.
+ *
+ * @udma: udma data structure
+ * @qid: queue index
+ */
+void udma_iofic_completion_config(struct udma *udma, u32 qid);
+
+/**
+ * udma_iofic_completion_ack() - Clear pending RX completion interrupt for given queue.
+ *
+ * @udma: udma data structure
+ * @qid: queue index
+ */
+void udma_iofic_completion_ack(struct udma *udma, u32 qid);
+
 /**
  * udma_state_set() - Change the UDMA's state
  *
@@ -436,6 +468,28 @@ int udma_m2m_init_queue(struct udma *udma, int qid, u32 m2s_ring_size, u32 s2m_r
 int udma_m2m_copy_prepare_one(struct udma *udma, u32 qid, dma_addr_t s_addr, dma_addr_t d_addr,
 			      u32 size, bool set_dmb, bool en_int);
 
+/**
+ * udma_m2m_copy_prepare_sg() - Prepare descriptors for one contiguous copy in a single pass.
+ *
+ * Splits the copy into MAX_DMA_DESC_SIZE descriptors; the queue handles are resolved and
+ * the ring space reserved once for the whole run, then the descriptors are written
+ * back-to-back. At most max_desc descriptors are prepared - when the copy needs more, the
+ * caller issues the rest in a following call after reclaiming ring space.
+ *
+ * @udma: DMA structure.
+ * @qid: Queue index.
+ * @s_addr: Source physical address.
+ * @d_addr: Destination physical address.
+ * @size: Size of the transfer.
+ * @max_desc: Maximum number of descriptor pairs to prepare.
+ * @set_dmb_last: Set the memory barrier bit on the last prepared descriptor.
+ * @prepared: Number of descriptor pairs actually prepared is stored here.
+ *
+ * Return: 0 if successful, a negative error code otherwise.
+ */
+int udma_m2m_copy_prepare_sg(struct udma *udma, u32 qid, dma_addr_t s_addr, dma_addr_t d_addr,
+			     u32 size, u32 max_desc, bool set_dmb_last, u32 *prepared);
+
 /**
  * udma_m2m_copy_start() - Start DMA transfer
  *
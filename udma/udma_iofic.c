@@ -340,6 +340,26 @@ static void udma_iofic_unmask_adv(struct udma *udma, enum udma_iofic_level level
 	iofic_unmask(udma_iofic_reg_base_get_adv(udma, level), group, mask);
 }
 
+void udma_iofic_completion_config(struct udma *udma, u32 qid)
+{
+	void __iomem *primary = udma_iofic_reg_base_get_adv(udma, UDMA_IOFIC_LEVEL_PRIMARY);
+
+	/* group B of the primary iofic is wired to the RX completion queues -
+	 * let it generate MSI-X(don't set INT_CONTROL_GRP_MASK_MSI_X)
+	 */
+	iofic_config(primary, INT_GROUP_B, INT_CONTROL_GRP_SET_ON_POSEDGE);
+	iofic_unmask(primary, INT_GROUP_B, BIT(qid));
+}
+
+void udma_iofic_completion_ack(struct udma *udma, u32 qid)
+{
+	struct iofic_regs __iomem *regs = (struct iofic_regs __iomem *)udma_iofic_reg_base_get_adv(
+		udma, UDMA_IOFIC_LEVEL_PRIMARY);
+
+	/* writing 0 clears the cause bit, 1 leaves other bits untouched */
+	reg_write32(&regs->ctrl[INT_GROUP_B].int_cause_grp, ~BIT(qid));
+}
+
 void udma_iofic_m2s_error_ints_unmask(struct udma *udma)
 {
 	u32 primary_grp_mask;
@@ -345,6 +345,71 @@ int udma_m2m_copy_prepare_one(struct udma *udma, u32 qid, dma_addr_t s_addr, dma
 					 set_dst_int);
 }
 
+/* Create descriptor pairs for a contiguous copy in one pass - the queue handles are
+ * looked up and the ring space checked once, then the m2s and s2m descriptors are
+ * written back-to-back so the rings are filled sequentially.
+ */
+int udma_m2m_copy_prepare_sg(struct udma *udma, u32 qid, dma_addr_t s_addr, dma_addr_t d_addr,
+			     u32 size, u32 max_desc, bool set_dmb_last, u32 *prepared)
+{
+	u32 ndesc, avail, i;
+	u32 remaining = size;
+	struct udma_q *txq;
+	struct udma_q *rxq;
+	int ret;
+
+	BUG_ON(udma == NULL);
+	if (qid >= udma->num_of_queues) {
+		return -1;
+	}
+	if (size == 0 || max_desc == 0) {
+		return -1;
+	}
+
+	ret = udma_q_handle_get(udma, qid, UDMA_TX, &txq);
+	if (ret) {
+		return ret;
+	}
+	ret = udma_q_handle_get(udma, qid, UDMA_RX, &rxq);
+	if (ret) {
+		return ret;
+	}
+
+	ndesc = DIV_ROUND_UP(size, MAX_DMA_DESC_SIZE);
+	if (ndesc > max_desc) {
+		ndesc = max_desc;
+	}
+	/* is there enough room in the m2s and s2m rings for the whole run? */
+	avail = udma_available_get(txq);
+	if (avail < ndesc) {
+		pr_err("not enough room in TX queue %d\n", txq->qid);
+		return -ENOMEM;
+	}
+	avail = udma_available_get(rxq);
+	if (avail < ndesc) {
+		pr_err("not enough room in RX queue %d\n", rxq->qid);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ndesc; i++) {
+		u32 chunk = remaining < MAX_DMA_DESC_SIZE ? remaining : MAX_DMA_DESC_SIZE;
+		bool last = (i == ndesc - 1);
+
+		ret = udma_m2m_build_descriptor(udma_desc_get(rxq), udma_desc_get(txq),
+						udma_ring_id_get(rxq), udma_ring_id_get(txq),
+						s_addr, d_addr, chunk, set_dmb_last && last,
+						false);
+		if (ret) {
+			return ret;
+		}
+		s_addr += chunk;
+		d_addr += chunk;
+		remaining -= chunk;
+	}
+	*prepared = ndesc;
+	return 0;
+}
+
 /* Start DMA data transfer for m2s_count/s2m_count number or descriptors */
 int udma_m2m_copy_start(struct udma *udma, u32 qid, u32 m2s_count, u32 s2m_count)
 {
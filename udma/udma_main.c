@@ -504,6 +504,29 @@ int udma_q_reset(struct udma_q *udma_q)
 	return 0;
 }
 
+/*
+ * Rewind a queue so descriptors already loaded in the ring can be executed again.
+ */
+int udma_q_rewind(struct udma_q *udma_q)
+{
+	if (udma_q->desc_base_ptr == NULL)
+		return -EINVAL;
+	/* RST_Q can not be used while a completion ring is configured */
+	if (udma_q->cdesc_size != 0)
+		return -EINVAL;
+
+	udma_q->next_desc_idx = 0;
+	udma_q->next_cdesc_idx = 0;
+	udma_q->comp_head_idx = 0;
+	udma_q->comp_head_ptr = (union udma_cdesc *)udma_q->cdesc_base_ptr;
+	udma_q->desc_ring_id = UDMA_INITIAL_RING_ID;
+	udma_q->comp_ring_id = UDMA_INITIAL_RING_ID;
+	udma_q->pkt_crnt_descs = 0;
+
+	udma_q_reset(udma_q);
+	return udma_q_set_pointers(udma_q);
+}
+
 /*
  * return (by reference) a pointer to a specific queue date structure.
  */
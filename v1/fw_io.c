@@ -16,10 +16,12 @@
 #define pr_fmt(fmt) "%s:%s: " fmt, KBUILD_MODNAME, __func__
 
 #include <linux/kernel.h>
+#include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/delay.h>
 #include <linux/fault-inject.h>
+#include <linux/crc32c.h>
 
 #include <v1/address_map.h>
 #include "../neuron_reg_access.h"
@@ -72,6 +74,18 @@ enum { FW_IO_REG_DEVICE_READY_OFFSET = 0x1c,
 #define FW_IO_REG_HAS_EAST_LINK_MASK 0x1
 #define FW_IO_REG_HAS_WEST_LINK_MASK 0x2
 
+int fw_io_csr_cache_ttl = 100;
+module_param(fw_io_csr_cache_ttl, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(fw_io_csr_cache_ttl, "Time(in msec) a cached CSR read stays valid. 0 disables the cache");
+
+// direct mapped cache of recently read CSR values - see fw_io_read_csr_array()
+#define FW_IO_CSR_CACHE_SIZE 512
+struct fw_io_csr_cache_entry {
+	u64 addr; // device physical address, 0 - entry is free
+	u32 value;
+	unsigned long expires; // jiffies after which the entry is stale
+};
+
 struct fw_io_ctx {
 	void __iomem *bar0;
 	u8 next_seq_num;
@@ -81,6 +95,8 @@ struct fw_io_ctx {
 	u64 response_addr;
 	u32 request_response_size; // for simplicity always use the same buffer size for request and response
 	struct mutex lock;
+	spinlock_t csr_cache_lock;
+	struct fw_io_csr_cache_entry csr_cache[FW_IO_CSR_CACHE_SIZE];
 };
 
 #define UINT64_LOW(x) ((u32)(((u64)(x)) & 0xffffffffULL))
@@ -108,62 +124,6 @@ static void fw_io_trigger(void __iomem *bar0)
 	reg_write32(bar0 + MMAP_APB_MISC_RAM_OFFSET + REG_WR_TRIGGER_INT_NOSEC_OFFSET, 1);
 }
 
-static const u32 crc32c_table[256] = {
-	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c, 0x26a1e7e8,
-	0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b, 0x4d43cfd0, 0xbf284cd3,
-	0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c, 0xf165b798, 0x030e349b, 0xd7c45070,
-	0x25afd373, 0x36ff2087, 0xc494a384, 0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54,
-	0x5d1d08bf, 0xaf768bbc, 0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29,
-	0x33ed7d2a, 0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
-	0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa, 0x30e349b1,
-	0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad, 0x1642ae59, 0xe4292d5a,
-	0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a, 0x7da08661, 0x8fcb0562, 0x9c9bf696,
-	0x6ef07595, 0x417b1dbc, 0xb3109ebf, 0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0,
-	0x67dafa54, 0x95b17957, 0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c,
-	0xfe53516f, 0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
-	0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f, 0x3ac7f2eb,
-	0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7, 0x61c69362, 0x93ad1061,
-	0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e, 0x4767748a, 0xb50cf789, 0xeb1fcbad,
-	0x197448ae, 0x0a24bb5a, 0xf84f3859, 0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46,
-	0x7198540d, 0x83f3d70e, 0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5,
-	0xa55230e6, 0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
-	0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c, 0x456cac67,
-	0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4, 0xe9141340, 0x1b7f9043,
-	0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c, 0x92a8fc17, 0x60c37f14, 0x73938ce0,
-	0x81f80fe3, 0x55326b08, 0xa759e80b, 0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db,
-	0xf94ad42f, 0x0b21572c, 0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6,
-	0x502036a5, 0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
-	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975, 0x0e330a81,
-	0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d, 0x758fe5d6, 0x87e466d5,
-	0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905, 0xd9f75af1, 0x2b9cd9f2, 0xff56bd19,
-	0x0d3d3e1a, 0x1e6dcdee, 0xec064eed, 0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530,
-	0x0417b1db, 0xf67c32d8, 0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc,
-	0x5a048dff, 0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
-	0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540, 0x590ab964,
-	0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78, 0x7fab5e8c, 0x8dc0dd8f,
-	0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee, 0x24aa3f05, 0xd6c1bc06, 0xc5914ff2,
-	0x37faccf1, 0x69e9f0d5, 0x9b8273d6, 0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9,
-	0x4f48173d, 0xbd23943e, 0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a,
-	0xc69f7b69, 0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
-	0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
-};
-
-static void dx_crc32c_add(const u8 *data, size_t len, u32 *csum)
-{
-	size_t i;
-
-	for (i = 0; i < len; i++) {
-		*csum = (*csum >> 8) ^ crc32c_table[(*csum ^ data[i]) & 0xff];
-	}
-}
-
-static u32 crc32c(const u8 *data, size_t len)
-{
-	u32 csum = 0xffffffff;
-	dx_crc32c_add(data, len, &csum);
-	return csum ^ 0xffffffff;
-}
-
 // Hardware might take up to 15 seconds in worst case.
 #define FW_IO_RD_TIMEOUT (1000 * 1000 * 15)
 
@@ -174,6 +134,7 @@ int fw_io_execute_request(struct fw_io_ctx *ctx, u8 command_id, const u8 *req, u
 	const u32 max_req_size = ctx->request_response_size - sizeof(struct fw_io_request);
 	const u32 max_resp_size = ctx->request_response_size - sizeof(struct fw_io_response);
 	u8 resp_seq;
+	u32 csum;
 	if (req_size > max_req_size) {
 		pr_err("invalid request size: %u, max: %u\n", req_size, max_req_size);
 		return -EINVAL;
@@ -188,25 +149,36 @@ int fw_io_execute_request(struct fw_io_ctx *ctx, u8 command_id, const u8 *req, u
 	if (++ctx->next_seq_num == 0)
 		ctx->next_seq_num = 1;
 
-	memcpy(ctx->request->data, req, req_size);
 	ctx->request->sequence_number = ctx->next_seq_num;
 	ctx->request->command_id = command_id;
 	ctx->request->size = req_size + sizeof(struct fw_io_request);
 	ctx->request->crc32 = 0;
-	ctx->request->crc32 = crc32c((const u8 *)ctx->request, ctx->request->size);
+	// checksum the header and the caller's buffer as the request is built instead of
+	// rereading the assembled request; crc32c() uses the CPU crc32 instruction when present
+	csum = crc32c(0xffffffff, ctx->request, sizeof(struct fw_io_request));
+	csum = crc32c(csum, req, req_size);
+	ctx->request->crc32 = csum ^ 0xffffffff;
+	memcpy(ctx->request->data, req, req_size);
 	// make sure the sequence number we will wait on is not the same
 	ctx->response->sequence_number = 0;
 	dma_rmb();
 	fw_io_trigger(ctx->bar0);
 	// now wait for resp->seq == req->seq which indicates that request has been completed and
 	// we have a response
-	u32 count = FW_IO_RD_TIMEOUT / 1000;
+	u64 waited = 0;
+	u32 wait = 1;
 	volatile u8 *fwio_seq = (volatile u8 *)&ctx->response->sequence_number;
-	for (; count > 0; count--) {
+	while (true) {
 		resp_seq = READ_ONCE(*fwio_seq);
 		if (resp_seq == ctx->next_seq_num)
 			break;
-		udelay(1000);
+		if (waited >= FW_IO_RD_TIMEOUT)
+			break;
+		// back off exponentially - fast requests complete after a few
+		// microseconds of polling, slow ones are checked every millisecond
+		udelay(wait);
+		waited += wait;
+		wait = min(wait * 2, 1000u);
 	}
 	ret = -1;
 	if (resp_seq != ctx->next_seq_num) {
@@ -252,6 +224,122 @@ static int fw_io_read(struct fw_io_ctx *ctx, u64 addr_in[], u32 val_out[], u32 n
 				     (u8 *)val_out, sizeof(u32) * num_req);
 }
 
+// size of the MISC RAM aperture holding the FWIO registers
+#define FW_IO_MISC_RAM_SIZE 0x1000
+
+// span of the event/semaphore registers in each NC window - events start at
+// MMAP_NC_EVENT_OFFSET and the last semaphore bank ends below 0x2000 after it
+#define FW_IO_NC_SYNC_SIZE 0x2000ull
+
+/* The event/semaphore registers are written by the driver with plain writel()
+ * and mutated by the hardware on its own, so a cached value goes stale without
+ * any invalidation point.
+ */
+static bool fw_io_csr_in_nc_sync(u64 addr)
+{
+	u64 offset;
+
+	if (addr < P_0_NC_0_BASE || addr >= P_0_NC_0_BASE + V1_NC_PER_DEVICE * MMAP_NC_SIZE)
+		return false;
+	offset = (addr - P_0_NC_0_BASE) % MMAP_NC_SIZE;
+	return offset >= MMAP_NC_EVENT_OFFSET && offset < MMAP_NC_EVENT_OFFSET + FW_IO_NC_SYNC_SIZE;
+}
+
+/** MISC RAM carries the mailbox and the reset/ready handshake words and the NC
+ * sync apertures change under the cache; reads of those must always reach the
+ * hardware, everything else can be served from the cache.
+ */
+static bool fw_io_csr_cacheable(u64 addr)
+{
+	if (addr >= P_0_APB_MISC_RAM_BASE && addr < P_0_APB_MISC_RAM_BASE + FW_IO_MISC_RAM_SIZE)
+		return false;
+	if (fw_io_csr_in_nc_sync(addr))
+		return false;
+	return true;
+}
+
+static u32 fw_io_csr_cache_hash(u64 addr)
+{
+	return (addr / sizeof(u32)) % FW_IO_CSR_CACHE_SIZE;
+}
+
+static bool fw_io_csr_cache_lookup(struct fw_io_ctx *ctx, u64 addr, u32 *value)
+{
+	struct fw_io_csr_cache_entry *entry = &ctx->csr_cache[fw_io_csr_cache_hash(addr)];
+	bool hit = false;
+
+	spin_lock(&ctx->csr_cache_lock);
+	if (entry->addr == addr && time_before(jiffies, entry->expires)) {
+		*value = entry->value;
+		hit = true;
+	}
+	spin_unlock(&ctx->csr_cache_lock);
+	return hit;
+}
+
+static void fw_io_csr_cache_insert(struct fw_io_ctx *ctx, u64 addr, u32 value)
+{
+	struct fw_io_csr_cache_entry *entry = &ctx->csr_cache[fw_io_csr_cache_hash(addr)];
+
+	spin_lock(&ctx->csr_cache_lock);
+	entry->addr = addr;
+	entry->value = value;
+	entry->expires = jiffies + msecs_to_jiffies(fw_io_csr_cache_ttl);
+	spin_unlock(&ctx->csr_cache_lock);
+}
+
+void fw_io_csr_cache_invalidate(struct fw_io_ctx *ctx)
+{
+	int i;
+
+	if (ctx == NULL)
+		return;
+	spin_lock(&ctx->csr_cache_lock);
+	for (i = 0; i < FW_IO_CSR_CACHE_SIZE; i++)
+		ctx->csr_cache[i].addr = 0;
+	spin_unlock(&ctx->csr_cache_lock);
+}
+
+// max number of registers can be read in single function call.
+#define MAX_READLESS_READ_REGISTER_COUNT 100
+
+/** Read the given CSRs, serving recently read ones from the cache.
+ * Only the misses go to the firmware, in a single mailbox transaction.
+ */
+static int fw_io_read_cached(struct fw_io_ctx *ctx, u64 addrs[], u32 values[], u32 num_csrs)
+{
+	u64 miss_addrs[MAX_READLESS_READ_REGISTER_COUNT];
+	u32 miss_values[MAX_READLESS_READ_REGISTER_COUNT];
+	u8 miss_idx[MAX_READLESS_READ_REGISTER_COUNT];
+	u32 i, miss_count = 0;
+	int ret;
+
+	if (fw_io_csr_cache_ttl <= 0)
+		return fw_io_read(ctx, addrs, values, num_csrs);
+
+	for (i = 0; i < num_csrs; i++) {
+		if (fw_io_csr_cacheable(addrs[i]) &&
+		    fw_io_csr_cache_lookup(ctx, addrs[i], &values[i]))
+			continue;
+		// gather the misses without disturbing the caller's address array
+		miss_addrs[miss_count] = addrs[i];
+		miss_idx[miss_count] = i;
+		miss_count++;
+	}
+	if (miss_count == 0)
+		return 0;
+
+	ret = fw_io_read(ctx, miss_addrs, miss_values, miss_count);
+	if (ret)
+		return ret;
+	for (i = 0; i < miss_count; i++) {
+		values[miss_idx[i]] = miss_values[i];
+		if (fw_io_csr_cacheable(miss_addrs[i]))
+			fw_io_csr_cache_insert(ctx, miss_addrs[i], miss_values[i]);
+	}
+	return 0;
+}
+
 /** Handle offset to device physical address mapping.
  *   1. All hardware reads must go through FWIO.
  *   2. FWIO understands only device physical addresses.
@@ -284,8 +372,6 @@ static int fw_io_register_read_region(struct fw_io_ctx *ctx, void __iomem *regio
 	return -1;
 }
 
-// max number of registers can be read in single function call.
-#define MAX_READLESS_READ_REGISTER_COUNT 100
 int fw_io_read_csr_array(void **ptrs, u32 *values, u32 num_csrs)
 {
 	int i, j;
@@ -307,7 +393,8 @@ int fw_io_read_csr_array(void **ptrs, u32 *values, u32 num_csrs)
 				off = ptrs[j] - start;
 				addrs[j] = fwio_read_regions[i].device_physical_address + off;
 			}
-			return fw_io_read(fwio_read_regions[i].ctx, addrs, values, num_csrs);
+			return fw_io_read_cached(fwio_read_regions[i].ctx, addrs, values,
+						 num_csrs);
 		}
 	}
 	return -1;
@@ -387,9 +474,10 @@ int fw_io_post_metric(struct fw_io_ctx *ctx, u8 *data, u32 size)
  */
 static bool fw_io_wait_for_device_ready(struct fw_io_ctx *ctx, u32 *reg_val)
 {
-	int i, ret;
+	int ret;
+	u64 waited = 0, wait = 1;
 	u64 addr = P_0_APB_MISC_RAM_BASE + FW_IO_REG_DEVICE_READY_OFFSET;
-	for (i = 0; i < DEVICE_MAX_READY_WAIT; i++) {
+	while (true) {
 		ret = fw_io_read(ctx, &addr, reg_val, 1);
 		if (ret) {
 			pr_err("failed to read device ready state\n");
@@ -397,12 +485,20 @@ static bool fw_io_wait_for_device_ready(struct fw_io_ctx *ctx, u32 *reg_val)
 		}
 		if (*reg_val & FW_IO_REG_DEVICE_READY_MASK)
 			return true;
-		msleep(1000);
+		if (waited >= DEVICE_MAX_READY_WAIT * MSEC_PER_SEC)
+			return false;
+		// back off exponentially - already ready devices are detected in
+		// milliseconds, slow ones are rechecked every second
+		if (wait < 20)
+			usleep_range(wait * USEC_PER_MSEC, wait * USEC_PER_MSEC * 2);
+		else
+			msleep(wait);
+		waited += wait;
+		wait = min_t(u64, wait * 2, MSEC_PER_SEC);
 	}
-	return false;
 }
 
-int fw_io_topology(struct fw_io_ctx *ctx, u32 *device_ids, int *count)
+int fw_io_topology(struct fw_io_ctx *ctx, u32 *device_ids, u64 *device_bases, int *count)
 {
 	int ret = 0, i;
 	u64 addr = P_0_APB_MISC_RAM_BASE + FW_IO_REG_DEVICE_READY_OFFSET;
@@ -416,8 +512,10 @@ int fw_io_topology(struct fw_io_ctx *ctx, u32 *device_ids, int *count)
 		return 1;
 
 	// assume no device is connected.
-	for (i = 0; i < MAX_NEURON_DEVICE_COUNT; i++)
+	for (i = 0; i < MAX_NEURON_DEVICE_COUNT; i++) {
 		device_ids[i] = -1;
+		device_bases[i] = 0;
+	}
 
 	// if east link is up, read the link's device's address
 	if (reg_val & FW_IO_REG_HAS_EAST_LINK_MASK) {
@@ -427,6 +525,7 @@ int fw_io_topology(struct fw_io_ctx *ctx, u32 *device_ids, int *count)
 			pr_err("failed to read east device id\n");
 			return 1;
 		}
+		device_bases[found] = PCIEX4_0_BASE;
 		found++;
 	}
 	// if west link is up, read the link's device's address
@@ -437,6 +536,7 @@ int fw_io_topology(struct fw_io_ctx *ctx, u32 *device_ids, int *count)
 			pr_err("failed to read west device id\n");
 			return 1;
 		}
+		device_bases[found] = PCIEX4_1_BASE;
 		found++;
 	}
 	*count = found;
@@ -447,6 +547,9 @@ int fw_io_topology(struct fw_io_ctx *ctx, u32 *device_ids, int *count)
 int fw_io_read_counters(struct fw_io_ctx *ctx, uint64_t addr_in[], uint32_t val_out[],
 			uint32_t num_counters)
 {
+	if (num_counters > MAX_READLESS_READ_REGISTER_COUNT)
+		return -EINVAL;
+	// counters advance on their own; the CSR cache would serve stale samples
 	return fw_io_read(ctx, addr_in, val_out, num_counters);
 }
 
@@ -464,6 +567,7 @@ struct fw_io_ctx *fw_io_setup(int device_index, void __iomem *bar0, u64 bar0_siz
 	ctx->bar0 = bar0;
 	ctx->next_seq_num = 1;
 	mutex_init(&ctx->lock);
+	spin_lock_init(&ctx->csr_cache_lock);
 
 	ctx->request = kmalloc(FW_IO_MAX_SIZE, GFP_ATOMIC);
 	if (ctx->request == NULL) {
@@ -52,6 +52,16 @@ int fw_io_post_metric(struct fw_io_ctx *ctx, u8 *data, u32 size);
  */
 int fw_io_read_csr_array(void **ptrs, u32 *values, u32 num_csrs);
 
+/**
+ * fw_io_csr_cache_invalidate() - Drop all cached CSR values of the device.
+ *
+ * Must be called after a register write or device reset which can change
+ * values the CSR read cache may be holding.
+ *
+ * @ctx: fwio context
+ */
+void fw_io_csr_cache_invalidate(struct fw_io_ctx *ctx);
+
 /**
  * fw_io_initiate_reset() - Initiate device local reset.
  *
@@ -83,12 +93,14 @@ bool fw_io_is_device_ready(void __iomem *bar0);
  *
  * @ctx: FWIO context of the device for which topology
  * @device_ids:  Connected device IDs are stored here.
+ * @device_bases: Base of the PCIe window(east/west) through which each connected
+ *		  device's address space is reachable.
  * @count: Number of devices connected to the given device.
  *
  * Return: 0 on success.
  *
  */
-int fw_io_topology(struct fw_io_ctx *ctx, u32 *device_ids, int *count);
+int fw_io_topology(struct fw_io_ctx *ctx, u32 *device_ids, u64 *device_bases, int *count);
 
 /**
  * fw_io_read_counters() - Reads hardware counters